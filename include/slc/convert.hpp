@@ -0,0 +1,600 @@
+#ifndef SLC_CONVERT_HPP
+#define SLC_CONVERT_HPP
+
+#include "slc/formats/v2.hpp"
+#include "slc/formats/v3.hpp"
+#include "slc/util.hpp"
+
+#include <array>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <span>
+#include <spanstream>
+#include <string>
+#include <vector>
+
+SLC_NS_BEGIN
+
+namespace convert {
+
+/**
+ * Gets the seed out of an slc2 meta.
+ *
+ * slc2 has no notion of a seed, but most bots store one as a `seed` member of
+ * their meta. Metas without one map to a seed of 0.
+ */
+struct MetaSeed {
+  template <typename M>
+  uint64_t operator()(const v2::MetaContainer<M> &container) const {
+    if constexpr (requires { container.m_meta.seed; }) {
+      return container.m_meta.seed;
+    } else {
+      return 0;
+    }
+  }
+
+  /**
+   * Store a seed in an slc2 meta. Returns false if the meta can't hold one.
+   */
+  template <typename M>
+  bool set(v2::MetaContainer<M> &container, uint64_t seed) const {
+    if constexpr (requires { container.m_meta.seed = seed; }) {
+      container.m_meta.seed = seed;
+      return true;
+    } else {
+      return false;
+    }
+  }
+};
+
+struct TranscodeStats {
+  // Inputs read from the slc2 replay.
+  size_t m_inputs = 0;
+  // Actions written to the slc3 replay.
+  size_t m_actions = 0;
+  // Skip inputs; these only advance the frame, so they're folded into the
+  // delta of the following action.
+  size_t m_skipped = 0;
+  // How the actions were encoded.
+  v3::EncodingReport m_encoding;
+};
+
+/**
+ * Convert an slc2 replay into an slc3 replay with a single action atom.
+ *
+ * Inputs are decoded one by one and fed straight into the section encoder,
+ * so memory use stays bounded no matter how long the replay is. The output
+ * stream has to be seekable, since sizes are patched in after the fact.
+ *
+ * Restart, RestartFull and Death inputs get the seed returned by `seedOf`,
+ * which is also stored in the slc3 metadata. TPS inputs keep their TPS.
+ */
+template <typename M = void, typename SeedOf = MetaSeed>
+v3::Result<TranscodeStats> v2ToV3(std::istream &in, std::ostream &out,
+                                  SeedOf seedOf = {}) {
+  using InputType = v2::Input::InputType;
+  using ActionType = v3::Action::ActionType;
+
+  TranscodeStats stats;
+  v3::Metadata meta{};
+  meta.m_tps = 240.0;
+
+  auto headerPos = out.tellp();
+  if (headerPos == -1) {
+    return std::unexpected("failed to query header position");
+  }
+
+  // The metadata is only known once the slc2 header has been read, so it gets
+  // patched in at the end
+  v3::Replay<>::writeHeader(out, meta);
+
+  v3::Result<> failure;
+
+  const auto body = [&](std::ostream &o) -> v3::Result<> {
+    auto countPos = o.tellp();
+    if (countPos == -1) {
+      return std::unexpected("failed to query count position");
+    }
+
+    util::binWrite<uint64_t>(o, 0);
+
+    // The atom header and the action count
+    stats.m_encoding.m_headerBytes =
+        sizeof(v3::AtomId) + sizeof(uint64_t) + sizeof(uint64_t);
+
+    v3::ActionEncoder encoder(o, &stats.m_encoding);
+
+    const auto onHeader = [&](const v2::Replay<M> &replay) {
+      meta.m_tps = replay.m_tps;
+      meta.m_seed = seedOf(replay);
+    };
+
+    const auto onInput = [&](const v2::Input &input) {
+      stats.m_inputs++;
+
+      if (!failure) {
+        return;
+      }
+
+      if (input.m_button == InputType::Skip) {
+        stats.m_skipped++;
+        return;
+      }
+
+      if (input.m_button == InputType::TPS) {
+        failure = encoder.push(v3::Action(0, input.m_frame, input.m_tps));
+        return;
+      }
+
+      const auto type = static_cast<ActionType>(input.m_button);
+
+      if (static_cast<int>(input.m_button) <
+          static_cast<int>(InputType::Restart)) {
+        failure = encoder.push(v3::Action(0, input.m_frame, type,
+                                          input.m_holding, input.m_player2));
+      } else {
+        failure = encoder.push(v3::Action(0, input.m_frame, type, meta.m_seed));
+      }
+    };
+
+    auto replay = v2::Replay<M>::stream(in, onHeader, onInput);
+    if (!replay) {
+      return std::unexpected("failed to read slc2 replay (error " +
+                             std::to_string(static_cast<int>(replay.error())) +
+                             ")");
+    }
+
+    TRY(failure);
+    TRY(encoder.finish());
+
+    stats.m_actions = encoder.count();
+
+    auto end = o.tellp();
+    o.seekp(countPos, std::ios::beg);
+    util::binWrite<uint64_t>(o, stats.m_actions);
+    o.seekp(end, std::ios::beg);
+
+    return {};
+  };
+
+  TRY(v3::writeAtom(out, v3::AtomId::Action, body));
+
+  v3::Replay<>::writeFooter(out);
+
+  auto end = out.tellp();
+  out.seekp(headerPos, std::ios::beg);
+  v3::Replay<>::writeHeader(out, meta);
+  out.seekp(end, std::ios::beg);
+
+  if (!out) {
+    return std::unexpected("failed to write slc3 replay");
+  }
+
+  return stats;
+}
+
+/**
+ * Something in an slc3 replay that slc2 can't represent.
+ */
+struct DowngradeIssue {
+  enum class Kind : uint8_t {
+    // An atom other than an action atom, or an action atom with flags that
+    // aren't supported, was dropped. `m_value` is its id.
+    UnsupportedAtom,
+    // A Restart, RestartFull or Death action had a seed other than the replay
+    // seed; slc2 only stores one seed. `m_value` is the dropped seed.
+    SeedDropped,
+    // The replay seed couldn't be stored because the slc2 meta has no seed.
+    // `m_value` is the dropped seed.
+    MetaSeedDropped,
+    // A Bugpoint action was written as a Skip input, which keeps its frame
+    // but not its meaning.
+    BugpointAsSkip,
+  };
+
+  Kind m_kind;
+  // Index of the atom in the slc3 replay.
+  size_t m_atom = 0;
+  // Frame of the affected action, if any.
+  uint64_t m_frame = 0;
+  uint64_t m_value = 0;
+};
+
+struct DowngradeReport {
+  // Action atoms that were merged into the slc2 replay.
+  size_t m_atoms = 0;
+  // Actions read from those atoms.
+  size_t m_actions = 0;
+  // Inputs written to the slc2 replay.
+  size_t m_inputs = 0;
+  std::vector<DowngradeIssue> m_issues;
+
+  bool lossless() const { return m_issues.empty(); }
+};
+
+namespace detail {
+
+/**
+ * Reads a range of a seekable stream buffer through a buffer of its own.
+ *
+ * It seeks the source before every refill, so any number of these can read
+ * from the same source side by side.
+ */
+class RangeReader : public std::streambuf {
+private:
+  static constexpr size_t BUFFER_SIZE = 16 * 1024;
+
+  std::streambuf &m_source;
+  std::array<char, BUFFER_SIZE> m_buffer;
+  std::streamoff m_next;
+  std::streamoff m_end;
+
+protected:
+  int_type underflow() override {
+    if (gptr() < egptr()) {
+      return traits_type::to_int_type(*gptr());
+    }
+
+    const auto wanted =
+        std::min<std::streamoff>(m_end - m_next, m_buffer.size());
+    if (wanted <= 0 ||
+        m_source.pubseekpos(m_next, std::ios::in) != std::streampos(m_next)) {
+      return traits_type::eof();
+    }
+
+    const auto got = m_source.sgetn(m_buffer.data(), wanted);
+    if (got <= 0) {
+      return traits_type::eof();
+    }
+
+    m_next += got;
+    setg(m_buffer.data(), m_buffer.data(), m_buffer.data() + got);
+    return traits_type::to_int_type(*gptr());
+  }
+
+public:
+  RangeReader(std::streambuf &source, std::streamoff begin,
+              std::streamoff end)
+      : m_source(source), m_next(begin), m_end(end) {
+    setg(m_buffer.data(), m_buffer.data(), m_buffer.data());
+  }
+};
+
+} // namespace detail
+
+/**
+ * Convert an slc3 replay into an slc2 replay.
+ *
+ * All action atoms are decoded section by section and merged by frame (ties
+ * keep atom order), and their actions are packed straight into slc2 input
+ * states. The replay seed goes into the slc2 meta through `seedOf.set`.
+ * Deltas too large for slc2 are split up with Skip inputs.
+ *
+ * The input stream has to be seekable. Atoms are decoded side by side with a
+ * cursor each, twice: once to find the blobs of the slc2 replay, and once to
+ * write their inputs, so memory use stays bounded by the blob count no matter
+ * how long the replay is. Only compressed atoms have their sections entropy
+ * decoded up front, which is taken out of the memory budget in `options`.
+ *
+ * Anything that can't be represented in slc2 is listed in the returned
+ * report instead of being dropped silently.
+ */
+template <typename M = void, typename SeedOf = MetaSeed>
+v3::Result<DowngradeReport> v3ToV2(std::istream &in, std::ostream &out,
+                                   SeedOf seedOf = {},
+                                   const ReadOptions &options = {}) {
+  using Container = v3::Replay<>;
+  using ActionType = v3::Action::ActionType;
+  using InputType = v2::Input::InputType;
+  using Issue = DowngradeIssue;
+
+  DowngradeReport report;
+  MemoryBudget budget(options.m_memoryBudget);
+
+  std::array<uint8_t, Container::HEADER_SIZE> headerBuf;
+  in.read(reinterpret_cast<char *>(headerBuf.data()), Container::HEADER_SIZE);
+  if (!in || Container::HEADER != headerBuf) {
+    return std::unexpected("invalid header in given container");
+  }
+
+  if (util::binRead<uint16_t>(in) != Container::META_SIZE) {
+    return std::unexpected(
+        "invalid metadata size, likely outdated or malformed replay");
+  }
+
+  const auto meta = util::binRead<v3::Metadata>(in);
+  if (!in) {
+    return std::unexpected("unexpected end of stream while reading metadata");
+  }
+
+  if (meta.m_checksum != 0 && meta.computeChecksum() != meta.m_checksum) {
+    return std::unexpected("metadata checksum mismatch");
+  }
+
+  const std::streamoff atomsStart = in.tellg();
+  if (atomsStart == -1) {
+    return std::unexpected("failed to query atoms position");
+  }
+
+  const std::streamoff footerPos = in.seekg(-1, std::ios::end).tellg();
+  if (footerPos < atomsStart ||
+      util::binRead<uint8_t>(in) != Container::FOOTER || !in) {
+    return std::unexpected("invalid footer in given container");
+  }
+
+  // Where the actions of an atom (or of one stream of a split atom) are,
+  // either in the input or in the decoded sections of a compressed atom
+  struct Range {
+    std::streamoff m_begin;
+    std::streamoff m_end;
+    uint64_t m_count;
+    v3::AtomFlags m_flags;
+    size_t m_atom;
+    // Index into `decoded`, if the range is in there
+    std::optional<size_t> m_decoded;
+  };
+
+  std::vector<Range> ranges;
+  std::vector<std::vector<char>> decoded;
+
+  std::streamoff pos = atomsStart;
+  for (size_t atom = 0; pos < footerPos; atom++) {
+    if (footerPos - pos < std::streamoff(sizeof(uint32_t) + sizeof(uint64_t))) {
+      return std::unexpected("truncated atom header");
+    }
+
+    in.seekg(pos);
+    const auto id = util::binRead<uint32_t>(in);
+    uint64_t size = util::binRead<uint64_t>(in);
+    pos += sizeof(id) + sizeof(size);
+
+    auto flags = v3::AtomFlags::unpack(size >> 56);
+    size &= ~(0xFFull << 56);
+    if (!in || size > uint64_t(footerPos - pos)) {
+      return std::unexpected("atom size exceeds remaining stream size");
+    }
+
+    const std::streamoff next = pos + size;
+
+    // Checksums are checked up front, since atoms are read out of order
+    // afterwards
+    if (flags.has(v3::AtomFlags::Checksummed)) {
+      if (size < sizeof(uint32_t)) {
+        return std::unexpected("checksummed atom is too small");
+      }
+
+      size -= sizeof(uint32_t);
+
+      v3::ChecksumReader checksumReader(*in.rdbuf(), size);
+      const auto actual = checksumReader.finish();
+      const uint32_t expected = util::binRead<uint32_t>(in);
+      if (!actual || !in) {
+        return std::unexpected("unexpected end of stream while reading atom");
+      }
+
+      if (*actual != expected) {
+        return std::unexpected("atom checksum mismatch");
+      }
+
+      flags.m_features &= ~v3::AtomFlags::Checksummed;
+      in.seekg(pos);
+    }
+
+    if (static_cast<v3::AtomId>(id) == v3::AtomId::Action &&
+        v3::ActionAtom::supports(flags)) {
+      if (size < sizeof(uint64_t)) {
+        return std::unexpected("truncated ActionAtom");
+      }
+
+      const auto count = util::binRead<uint64_t>(in);
+      Range range{.m_begin = pos + std::streamoff(sizeof(count)),
+                  .m_end = pos + std::streamoff(size),
+                  .m_count = count,
+                  .m_flags = flags,
+                  .m_atom = atom,
+                  .m_decoded = std::nullopt};
+
+      if (flags.has(v3::AtomFlags::Compressed)) {
+        decoded.push_back(TRY(v3::readCompressedSections(
+            in, range.m_end - range.m_begin, count, budget)));
+
+        range.m_begin = 0;
+        range.m_end = decoded.back().size();
+        range.m_decoded = decoded.size() - 1;
+      }
+
+      // Split atoms hold a stream per player, which are merged like atoms
+      if (flags.has(v3::AtomFlags::Split)) {
+        if (range.m_end - range.m_begin < std::streamoff(2 * sizeof(uint64_t))) {
+          return std::unexpected("truncated split ActionAtom");
+        }
+
+        uint64_t counts[2];
+        if (range.m_decoded) {
+          std::memcpy(counts, decoded.back().data(), sizeof(counts));
+        } else {
+          in.read(reinterpret_cast<char *>(counts), sizeof(counts));
+        }
+
+        const auto [secondCount, firstSize] = counts;
+        range.m_begin += sizeof(counts);
+
+        if (secondCount > count ||
+            firstSize > uint64_t(range.m_end - range.m_begin)) {
+          return std::unexpected("split ActionAtom streams exceed the atom");
+        }
+
+        Range second = range;
+        second.m_begin += firstSize;
+        second.m_count = secondCount;
+
+        range.m_end = second.m_begin;
+        range.m_count -= secondCount;
+
+        ranges.push_back(range);
+        ranges.push_back(second);
+      } else {
+        ranges.push_back(range);
+      }
+
+      report.m_atoms++;
+    } else if (static_cast<v3::AtomId>(id) != v3::AtomId::Null) {
+      report.m_issues.push_back({.m_kind = Issue::Kind::UnsupportedAtom,
+                                 .m_atom = atom,
+                                 .m_value = id});
+    }
+
+    pos = next;
+  }
+
+  v2::MetaContainer<M> v2Meta{};
+  if (!seedOf.set(v2Meta, meta.m_seed) && meta.m_seed != 0) {
+    report.m_issues.push_back(
+        {.m_kind = Issue::Kind::MetaSeedDropped, .m_value = meta.m_seed});
+  }
+
+  // A cursor over one range
+  struct Source {
+    std::unique_ptr<std::streambuf> m_buffer;
+    std::istream m_stream;
+    v3::ActionDecoder m_decoder;
+
+    Source(std::unique_ptr<std::streambuf> buffer, const Range &range)
+        : m_buffer(std::move(buffer)), m_stream(m_buffer.get()),
+          m_decoder(m_stream, range.m_count,
+                    v3::EncodingOptions::forVersion(range.m_flags.m_version)) {
+    }
+  };
+
+  // slc2 deltas are stored above the 5 state bits
+  constexpr uint64_t MAX_DELTA = (1ull << 59) - 1;
+
+  // Merge the actions of all ranges from the start, and pass each of them to
+  // `onAction`, along with the atom it came from and a function that passes
+  // the input states it's packed into to a callback
+  const auto decode = [&](auto &&onAction) -> v3::Result<> {
+    // Sources hold streams the decoders point into, so they can't move
+    std::vector<std::unique_ptr<Source>> sources;
+    std::vector<v3::ActionDecoder *> decoders;
+
+    for (const Range &range : ranges) {
+      std::unique_ptr<std::streambuf> buffer;
+      if (range.m_decoded) {
+        std::span<char> sections(decoded[*range.m_decoded]);
+        buffer = std::make_unique<std::spanbuf>(
+            sections.subspan(range.m_begin, range.m_end - range.m_begin),
+            std::ios::in);
+      } else {
+        buffer = std::make_unique<detail::RangeReader>(
+            *in.rdbuf(), range.m_begin, range.m_end);
+      }
+
+      sources.push_back(std::make_unique<Source>(std::move(buffer), range));
+      decoders.push_back(&sources.back()->m_decoder);
+    }
+
+    v3::ActionMerger merger(std::move(decoders));
+    uint64_t previousFrame = 0;
+
+    while (const v3::Action *merged = TRY(merger.next())) {
+      const v3::Action &action = *merged;
+
+      const auto pack = [&](auto &&emit) {
+        uint64_t delta = action.m_frame - previousFrame;
+        for (; delta > MAX_DELTA; delta -= MAX_DELTA) {
+          emit(v2::Input::packState(MAX_DELTA, InputType::Skip, false, false),
+               0.0);
+        }
+
+        switch (action.m_type) {
+        case ActionType::Jump:
+        case ActionType::Left:
+        case ActionType::Right:
+          emit(v2::Input::packState(delta,
+                                    static_cast<InputType>(action.m_type),
+                                    action.m_player2, action.m_holding),
+               0.0);
+          break;
+        case ActionType::Restart:
+        case ActionType::RestartFull:
+        case ActionType::Death:
+          emit(v2::Input::packState(
+                   delta, static_cast<InputType>(action.m_type), false, false),
+               0.0);
+          break;
+        case ActionType::TPS:
+          emit(v2::Input::packState(delta, InputType::TPS, false, false),
+               action.m_tps);
+          break;
+        case ActionType::Bugpoint:
+        case ActionType::Reserved:
+          emit(v2::Input::packState(delta, InputType::Skip, false, false),
+               0.0);
+          break;
+        }
+      };
+
+      onAction(action, ranges[merger.source()].m_atom, pack);
+      previousFrame = action.m_frame;
+    }
+
+    return {};
+  };
+
+  // The first pass finds the blobs, and what doesn't fit into slc2
+  v2::_Blob::Partitioner partitioner;
+
+  TRY(decode([&](const v3::Action &action, size_t atom, auto &&pack) {
+    report.m_actions++;
+
+    switch (action.m_type) {
+    case ActionType::Restart:
+    case ActionType::RestartFull:
+    case ActionType::Death:
+      if (action.m_seed != meta.m_seed) {
+        report.m_issues.push_back({.m_kind = Issue::Kind::SeedDropped,
+                                   .m_atom = atom,
+                                   .m_frame = action.m_frame,
+                                   .m_value = action.m_seed});
+      }
+      break;
+    case ActionType::Bugpoint:
+    case ActionType::Reserved:
+      report.m_issues.push_back({.m_kind = Issue::Kind::BugpointAsSkip,
+                                 .m_atom = atom,
+                                 .m_frame = action.m_frame});
+      break;
+    default:
+      break;
+    }
+
+    pack([&](uint64_t state, double) {
+      partitioner.push(v2::Input::requiredBytes(state));
+      report.m_inputs++;
+    });
+  }));
+
+  // The second one writes them
+  typename v2::Replay<M>::StateWriter writer(out, meta.m_tps, v2Meta,
+                                             std::move(partitioner).finish());
+
+  TRY(decode([&](const v3::Action &, size_t, auto &&pack) {
+    pack([&](uint64_t state, double tps) { writer.push(state, tps); });
+  }));
+
+  writer.finish();
+
+  if (!out) {
+    return std::unexpected("failed to write slc2 replay");
+  }
+
+  return report;
+}
+
+} // namespace convert
+
+SLC_NS_END
+
+#endif // SLC_CONVERT_HPP
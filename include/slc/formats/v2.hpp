@@ -3,10 +3,17 @@
 
 #include "slc/util.hpp"
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
 #include <cstring>
 #include <expected>
 #include <iostream>
+#include <memory>
 #include <print>
+#include <span>
+#include <stdexcept>
 #include <type_traits>
 #include <vector>
 
@@ -80,8 +87,7 @@ public:
   Input() : m_state(0) {}
   Input(uint64_t currentFrame, uint64_t delta, InputType type, bool p2,
         bool hold) {
-    m_state =
-        (delta << 5) | (static_cast<uint8_t>(type) << 2) | (p2 << 1) | hold;
+    m_state = packState(delta, type, p2, hold);
 
     m_delta = delta;
     m_frame = currentFrame + delta;
@@ -103,17 +109,43 @@ public:
     if (m_button == InputType::TPS)
       return 8;
 
-    if (m_state < 0x100) {
+    return requiredBytes(m_state);
+  }
+
+  /**
+   * How many bytes a packed input state takes up on disk.
+   */
+  static inline uint8_t requiredBytes(uint64_t state) {
+    if (isTPS(state)) {
+      return 8;
+    }
+
+    if (state < 0x100) {
       return 1;
-    } else if (m_state < 0x10000) {
+    } else if (state < 0x10000) {
       return 2;
-    } else if (m_state < 0x100000000) {
+    } else if (state < 0x100000000) {
       return 4;
     } else {
       return 8;
     }
   }
 
+  /**
+   * Whether a packed input state belongs to a TPS input.
+   */
+  static constexpr bool isTPS(uint64_t state) {
+    return ((state & 0b11100) >> 2) == static_cast<uint8_t>(InputType::TPS);
+  }
+
+  /**
+   * Pack an input into its in-file representation.
+   */
+  static constexpr uint64_t packState(uint64_t delta, InputType type, bool p2,
+                                      bool hold) {
+    return (delta << 5) | (static_cast<uint8_t>(type) << 2) | (p2 << 1) | hold;
+  }
+
   void updateHelpers(uint64_t currentFrame) {
     m_delta = m_state >> 5;
     m_frame = currentFrame + (m_state >> 5);
@@ -121,6 +153,44 @@ public:
     m_button = static_cast<InputType>((m_state & 0b11100) >> 2);
     m_holding = m_state & 1;
   }
+
+  /**
+   * Create an input from its packed state.
+   * `tps` is only used if the state belongs to a TPS input.
+   */
+  static Input fromState(uint64_t state, uint64_t currentFrame,
+                         double tps = 0.0) {
+    Input input;
+    input.m_state = state;
+    input.updateHelpers(currentFrame);
+
+    if (input.m_button == InputType::TPS) {
+      input.m_tps = tps;
+    }
+
+    return input;
+  }
+
+  /**
+   * The packed state of the input, as it's stored on disk.
+   */
+  uint64_t state() const { return m_state; }
+};
+
+enum class ReplayError {
+  OpenFileError,
+  HeaderMismatchError,
+  FooterMismatchError,
+  MetaSizeMismatchError,
+
+  IncorrectFrameError,
+
+  // The data ends before everything the replay declares could be read
+  UnexpectedEndError,
+  // The blob table doesn't describe the inputs of the replay
+  MalformedBlobError,
+  // The inputs of the replay don't fit in the memory budget of the read
+  MemoryBudgetError,
 };
 
 class _Blob {
@@ -133,6 +203,9 @@ public:
   // How long the blob is in the inputs vector.
   uint64_t m_length;
 
+  // How many bytes the blob takes up in the blob table.
+  static constexpr uint64_t META_SIZE = 3 * sizeof(uint64_t);
+
 public:
   _Blob() = default;
   _Blob(uint64_t size, uint64_t start)
@@ -157,37 +230,457 @@ public:
     util::binWrite(s, m_length);
   }
 
-  void write(std::ostream &s, const std::vector<Input> &inputs) const {
-    if (m_length <= 0)
-      return;
+  /**
+   * Write the inputs of this blob.
+   *
+   * `stateAt(i)` returns the packed state of input `i`, and `tpsAt(i)` its
+   * TPS; the latter is only called for TPS inputs, in ascending order.
+   */
+  template <typename S, typename T>
+    requires std::invocable<S &, uint64_t> && std::invocable<T &, uint64_t>
+  void write(std::ostream &s, S &&stateAt, T &&tpsAt) const {
+    for (uint64_t i = m_start; i < m_start + m_length; i++) {
+      const uint64_t state = stateAt(i);
+      writeInput(s, state, [&] { return tpsAt(i); });
+    }
+  }
 
+  /**
+   * Write a single input at the byte size of this blob. `tps` is only called
+   * for TPS inputs.
+   */
+  template <typename T>
+    requires std::invocable<T &>
+  void writeInput(std::ostream &s, uint64_t fullState, T &&tps) const {
     uint64_t byteMask =
         m_byteSize == 8 ? -((uint64_t)1) : (1ull << (m_byteSize * 8ull)) - 1ull;
+    uint64_t state = fullState & byteMask;
 
-    for (uint64_t i = m_start; i < m_start + m_length; i++) {
-      uint64_t state = inputs.at(i).m_state & byteMask;
+    s.write(reinterpret_cast<const char *>(reinterpret_cast<uintptr_t>(&state)),
+            m_byteSize);
+
+    if (Input::isTPS(fullState)) {
+      util::binWrite<double>(s, tps());
+    }
+  }
+
+  void write(std::ostream &s, const std::vector<Input> &inputs) const {
+    write(
+        s, [&](uint64_t i) { return inputs.at(i).m_state; },
+        [&](uint64_t i) { return inputs.at(i).m_tps; });
+  }
+
+  /**
+   * Splits inputs into blobs as they come, given the size each input
+   * requires.
+   *
+   * The split is optimal; no other split of the inputs takes up fewer bytes,
+   * blob metadata included. Every input adds one step to a dynamic program
+   * over the byte size of its blob. The choices made along the way are only
+   * kept until every way the split can still go agrees on the blobs before
+   * them, which is usually a few blobs back, so memory stays proportional to
+   * the blobs rather than to the inputs.
+   */
+  class Partitioner {
+  private:
+    // Byte sizes are 1 << w for w in [0, 4)
+    static constexpr size_t WIDTHS = 4;
+    static constexpr uint64_t UNREACHABLE = UINT64_MAX / 2;
+    // How many inputs go by between tries to settle blobs, at least
+    static constexpr uint64_t SETTLE_INTERVAL = 1024;
+
+    // m_cost[w] is the smallest amount of bytes the inputs so far can be
+    // saved in, given that the last one ends up in a blob of byte size
+    // 1 << w. The next input either joins the blob of the last one (if it
+    // has the same byte size), or starts a new one and pays for its
+    // metadata.
+    std::array<uint64_t, WIDTHS> m_cost;
+
+    // For every input from m_anchor on, the width the input before it had
+    // for each width of the input, packed 2 bits per width. The width only
+    // differs when a blob starts.
+    std::vector<uint8_t> m_previous;
+    // The first input that isn't in a settled blob, which starts a blob
+    uint64_t m_first = 0;
+    // Every path goes through the same width at the input before this one,
+    // which shares a blob with all inputs since m_first
+    uint64_t m_anchor = 0;
+    uint64_t m_count = 0;
+    uint64_t m_nextSettle = SETTLE_INTERVAL;
+
+    std::vector<_Blob> m_blobs;
+
+    size_t widthBefore(uint64_t input, size_t width) const {
+      return (m_previous[input - m_anchor] >> (width * 2)) & 0b11;
+    }
+
+    /**
+     * Add the blobs of inputs `[m_first, end)` to the settled ones, given
+     * the width of the input before `end`, which starts no blob. Returns
+     * the start of the blob holding that input.
+     */
+    uint64_t backtrack(uint64_t end, size_t width) {
+      const size_t settled = m_blobs.size();
+      uint64_t blobEnd = end;
+
+      for (uint64_t i = end - 1; i > m_first && i >= m_anchor; i--) {
+        const size_t before = widthBefore(i, width);
+
+        if (before != width) {
+          m_blobs.push_back(_Blob(1ull << width, i));
+          m_blobs.back().m_length = blobEnd - i;
+
+          blobEnd = i;
+          width = before;
+        }
+      }
+
+      m_blobs.push_back(_Blob(1ull << width, m_first));
+      m_blobs.back().m_length = blobEnd - m_first;
+
+      std::reverse(m_blobs.begin() + settled, m_blobs.end());
+      return m_blobs.back().m_start;
+    }
+
+    /**
+     * Settle the blobs every way of continuing the split agrees on, and
+     * drop the choices that lead up to them.
+     */
+    void settle() {
+      // Backs off while paths keep disagreeing, so this stays linear
+      m_nextSettle = m_count + std::max(SETTLE_INTERVAL, m_count - m_anchor);
+
+      // The widths the last input can still end up with, and the widths
+      // the inputs before it have on those paths
+      uint8_t widths = 0;
+      for (size_t w = 0; w < WIDTHS; w++) {
+        if (m_cost[w] < UNREACHABLE) {
+          widths |= 1 << w;
+        }
+      }
 
-      s.write(
-          reinterpret_cast<const char *>(reinterpret_cast<uintptr_t>(&state)),
-          m_byteSize);
+      // Paths can't disagree before the anchor
+      uint64_t agreed = m_count - 1;
+      while (std::popcount(widths) > 1) {
+        if (agreed == m_anchor) {
+          return;
+        }
+
+        uint8_t before = 0;
+        for (size_t w = 0; w < WIDTHS; w++) {
+          if (widths & (1 << w)) {
+            before |= 1 << widthBefore(agreed, w);
+          }
+        }
+
+        widths = before;
+        agreed--;
+      }
+
+      // Every path has input `agreed` in the same blob, but that blob may
+      // still grow, so only the blobs before it are settled
+      m_first = backtrack(agreed + 1, std::countr_zero(widths));
+      m_blobs.pop_back();
+
+      m_previous.erase(m_previous.begin(),
+                       m_previous.begin() + (agreed + 1 - m_anchor));
+      m_anchor = agreed + 1;
+      m_nextSettle = m_count + std::max(SETTLE_INTERVAL, m_count - m_anchor);
+    }
+
+  public:
+    Partitioner() { m_cost.fill(UNREACHABLE); }
+
+    /**
+     * Add the next input, which requires `inputSize` bytes.
+     */
+    void push(uint8_t inputSize) {
+      size_t best = 0;
+      for (size_t w = 1; w < WIDTHS; w++) {
+        if (m_cost[w] < m_cost[best]) {
+          best = w;
+        }
+      }
+
+      const uint64_t startCost =
+          (m_count == 0 ? 0 : m_cost[best]) + sizeof(_Blob);
+
+      std::array<uint64_t, WIDTHS> next;
+      uint8_t choices = 0;
+
+      for (size_t w = 0; w < WIDTHS; w++) {
+        const uint64_t byteSize = 1ull << w;
+
+        if (byteSize < inputSize) {
+          next[w] = UNREACHABLE;
+          choices |= w << (w * 2);
+        } else if (m_cost[w] <= startCost) {
+          next[w] = m_cost[w] + byteSize;
+          choices |= w << (w * 2);
+        } else {
+          next[w] = startCost + byteSize;
+          choices |= best << (w * 2);
+        }
+      }
+
+      m_cost = next;
+      m_previous.push_back(choices);
+      m_count++;
+
+      if (m_count >= m_nextSettle) {
+        settle();
+      }
+    }
+
+    /**
+     * The blobs of all inputs that have been added.
+     */
+    std::vector<_Blob> finish() && {
+      if (m_count > 0) {
+        backtrack(m_count, std::min_element(m_cost.begin(), m_cost.end()) -
+                               m_cost.begin());
+      }
+
+      return std::move(m_blobs);
+    }
+  };
+
+  /**
+   * Split `count` inputs into blobs, given the size each input requires.
+   * See [`Partitioner`].
+   */
+  template <typename F>
+    requires std::invocable<F &, uint64_t>
+  static std::vector<_Blob> partition(uint64_t count, F &&requiredBytesAt) {
+    Partitioner partitioner;
+    for (uint64_t i = 0; i < count; i++) {
+      partitioner.push(requiredBytesAt(i));
+    }
+
+    return std::move(partitioner).finish();
+  }
 
-      if (inputs.at(i).m_button == Input::InputType::TPS) {
-        util::binWrite(s, inputs.at(i).m_tps);
+  /**
+   * Buffers the data of the blobs of a replay while they're read.
+   *
+   * Blobs are usually short, so data is read from the stream in large reads
+   * that span blobs, but never past the bytes the blobs are known to hold
+   * (TPS inputs add to that once they're found), so the stream ends up right
+   * after the last blob. Blobs are unpacked `CHUNK_SIZE` inputs at a time.
+   */
+  class ReadBuffer {
+  public:
+    static constexpr size_t CHUNK_SIZE = 2048;
+
+    // The states of a chunk, and the frame before each of them
+    std::unique_ptr<uint64_t[]> m_states =
+        std::make_unique_for_overwrite<uint64_t[]>(CHUNK_SIZE);
+    std::unique_ptr<uint64_t[]> m_frames =
+        std::make_unique_for_overwrite<uint64_t[]>(CHUNK_SIZE);
+
+  private:
+    static constexpr size_t CAPACITY = 64 * 1024;
+
+    // Not zeroed, since it's always read into first
+    std::unique_ptr<uint8_t[]> m_bytes =
+        std::make_unique_for_overwrite<uint8_t[]>(CAPACITY);
+    size_t m_begin = 0;
+    size_t m_end = 0;
+    // How many more bytes the stream holds at least
+    uint64_t m_pending;
+
+  public:
+    explicit ReadBuffer(uint64_t pending) : m_pending(pending) {}
+
+    /**
+     * Make at least `size` bytes available, unless the stream ends first.
+     * Returns how many bytes are available.
+     */
+    size_t fill(std::istream &s, size_t size) {
+      if (m_end - m_begin >= size) {
+        return m_end - m_begin;
+      }
+
+      std::memmove(m_bytes.get(), m_bytes.get() + m_begin, m_end - m_begin);
+      m_end -= m_begin;
+      m_begin = 0;
+
+      const size_t wanted = std::min<uint64_t>(CAPACITY - m_end, m_pending);
+      if (wanted > 0) {
+        s.read(reinterpret_cast<char *>(m_bytes.get() + m_end), wanted);
+        m_end += s.gcount();
+        m_pending -= s.gcount();
+      }
+
+      return m_end - m_begin;
+    }
+
+    const uint8_t *data() const { return m_bytes.get() + m_begin; }
+
+    void consume(size_t size) { m_begin += size; }
+
+    /**
+     * Read up to `size` bytes into `dest`. Returns how many were read.
+     */
+    size_t read(std::istream &s, void *dest, size_t size) {
+      const size_t got = std::min(fill(s, size), size);
+      std::memcpy(dest, data(), got);
+      consume(got);
+      return got;
+    }
+
+    /**
+     * Account for the TPS of a TPS input that was just found.
+     */
+    void expectTPS() { m_pending += sizeof(double); }
+  };
+
+  /**
+   * How many bytes the data of this blob takes up at least, TPS inputs
+   * aside.
+   */
+  uint64_t minDataSize() const {
+    return m_length * std::min<uint64_t>(m_byteSize, sizeof(uint64_t));
+  }
+
+  /**
+   * Read the inputs of this blob.
+   *
+   * The blob is read a chunk at a time, assuming it has no TPS inputs. The
+   * states of a chunk are widened into an array, frames are a prefix sum
+   * over their deltas, and only then are inputs filled in. TPS inputs are
+   * followed by their TPS, which shifts the rest of the chunk, so a chunk
+   * that has one is only unpacked up to it.
+   */
+  void read(std::istream &s, std::vector<Input> &inputs, uint64_t &frame,
+            ReadBuffer &buffer) const {
+    if (m_start > inputs.size() || m_length > inputs.size() - m_start) {
+      throw std::out_of_range("blob exceeds the length of the replay");
+    }
+
+    switch (m_byteSize) {
+    case 1:
+      readAs<uint8_t>(s, inputs, frame, buffer);
+      break;
+    case 2:
+      readAs<uint16_t>(s, inputs, frame, buffer);
+      break;
+    case 4:
+      readAs<uint32_t>(s, inputs, frame, buffer);
+      break;
+    case 8:
+      readAs<uint64_t>(s, inputs, frame, buffer);
+      break;
+    default:
+      // The writer never makes these, but they're still readable
+      if (m_byteSize > sizeof(uint64_t)) {
+        throw std::out_of_range("blob byte size is too large");
+      }
+
+      for (uint64_t i = m_start; i < m_start + m_length; i++) {
+        inputs[i].m_state = 0;
+        if (buffer.read(s, &inputs[i].m_state, m_byteSize) < m_byteSize) {
+          // Truncated; the footer check reports this
+          return;
+        }
+
+        inputs[i].updateHelpers(frame);
+        frame = inputs[i].m_frame;
+
+        if (inputs[i].m_button == Input::InputType::TPS) {
+          buffer.expectTPS();
+          buffer.read(s, &inputs[i].m_tps, sizeof(double));
+        }
       }
     }
   }
 
   void read(std::istream &s, std::vector<Input> &inputs, uint64_t &frame) {
-    for (uint64_t i = m_start; i < m_start + m_length; i++) {
-      s.read(reinterpret_cast<char *>(
-                 reinterpret_cast<uintptr_t>(&inputs.at(i).m_state)),
-             m_byteSize);
+    ReadBuffer buffer(minDataSize());
+    read(s, inputs, frame, buffer);
+  }
+
+  /**
+   * Read the inputs of this blob one at a time, passing each of them to
+   * `callback` instead of storing them.
+   */
+  template <typename F>
+    requires std::invocable<F &, const Input &>
+  void stream(std::istream &s, uint64_t &frame, F &&callback) const {
+    Input input;
+
+    for (uint64_t i = 0; i < m_length; i++) {
+      input.m_state = 0;
+      s.read(reinterpret_cast<char *>(&input.m_state), m_byteSize);
+
+      input.updateHelpers(frame);
+      frame = input.m_frame;
+
+      input.m_tps = input.m_button == Input::InputType::TPS
+                        ? util::binRead<double>(s)
+                        : 0.0;
+
+      callback(input);
+    }
+  }
+
+private:
+  template <typename T>
+  void readAs(std::istream &s, std::vector<Input> &inputs, uint64_t &frame,
+              ReadBuffer &buffer) const {
+    uint64_t *states = buffer.m_states.get();
+    uint64_t *frames = buffer.m_frames.get();
+
+    uint64_t i = m_start;
+    const uint64_t end = m_start + m_length;
+
+    while (i < end) {
+      const size_t wanted =
+          std::min<uint64_t>(end - i, ReadBuffer::CHUNK_SIZE);
+      const size_t count =
+          std::min(buffer.fill(s, wanted * sizeof(T)) / sizeof(T), wanted);
+      if (count == 0) {
+        // Truncated; the footer check reports this
+        return;
+      }
+
+      const uint8_t *bytes = buffer.data();
+      bool anyTPS = false;
+      for (size_t k = 0; k < count; k++) {
+        T state;
+        std::memcpy(&state, bytes + k * sizeof(T), sizeof(T));
+        states[k] = state;
+        anyTPS |= Input::isTPS(state);
+      }
+
+      // Past the first TPS input, the chunk is shifted by its TPS
+      size_t used = count;
+      if (anyTPS) [[unlikely]] {
+        used = 0;
+        while (!Input::isTPS(states[used])) {
+          used++;
+        }
+
+        used++;
+      }
+
+      for (size_t k = 0; k < used; k++) {
+        frames[k] = frame;
+        frame += states[k] >> 5;
+      }
+
+      for (size_t k = 0; k < used; k++) {
+        Input &input = inputs[i + k];
+        input.m_state = states[k];
+        input.updateHelpers(frames[k]);
+      }
 
-      inputs.at(i).updateHelpers(frame);
-      frame = inputs.at(i).m_frame;
+      i += used;
+      buffer.consume(used * sizeof(T));
 
-      if (inputs.at(i).m_button == Input::InputType::TPS) {
-        inputs.at(i).m_tps = util::binRead<double>(s);
+      if (anyTPS) {
+        buffer.expectTPS();
+        buffer.read(s, &inputs[i - 1].m_tps, sizeof(double));
       }
     }
   }
@@ -200,6 +693,8 @@ public:
 
 template <> class MetaContainer<void> {};
 
+template <typename M> class ReplayView;
+
 /**
  * An slc replay.
  *
@@ -225,20 +720,18 @@ input.
  */
 template <typename M = void> class Replay : public MetaContainer<M> {
 private:
+  template <typename> friend class ReplayView;
+
   static constexpr char HEADER[] = "SILL";
   static constexpr char FOOTER[] = "EOM";
 
   using Meta = M;
   using Self = Replay<Meta>;
 
-  enum class ReplayError {
-    OpenFileError,
-    HeaderMismatchError,
-    FooterMismatchError,
-    MetaSizeMismatchError,
+public:
+  using ReplayError = v2::ReplayError;
 
-    IncorrectFrameError,
-  };
+private:
 
   // It's much faster to do one lookup rather than two lookups for
   // input retrieval during runtime; therefore blobs may only
@@ -337,9 +830,11 @@ public:
    * This mutates the underlying `m_inputs` vector.
    */
   void pruneAfterFrame(const uint64_t frame) {
-    std::erase_if(this->m_inputs, [frame](const Input &input) {
-      return input.m_frame >= frame;
-    });
+    // Inputs are sorted by frame, so everything from the first one on or
+    // after `frame` goes
+    auto first = std::ranges::lower_bound(this->m_inputs, frame, {},
+                                          &Input::m_frame);
+    this->m_inputs.erase(first, this->m_inputs.end());
   }
 
   /**
@@ -365,11 +860,100 @@ public:
    * # Errors
    * - HeaderMismatchError if the header doesn't match
    * - MetaSizeMismatchError if the meta's size doesn't match
+   * - MalformedBlobError if the blob table doesn't cover the inputs exactly
+   * - UnexpectedEndError if the stream is too short for what it declares
+   * - MemoryBudgetError if the blob table or the inputs don't fit in
+   *   `options.m_memoryBudget`
    * - FooterMismatchError if the footer doesn't match
    */
   [[nodiscard]]
-  static std::expected<Self, ReplayError> read(std::istream &s) {
+  static std::expected<Self, ReplayError>
+  read(std::istream &s, const ReadOptions &options = {}) {
+    Self replay;
+    uint64_t length = 0;
+    std::vector<_Blob> blobs;
+    MemoryBudget budget(options.m_memoryBudget);
+
+    if (auto result = readPreamble(s, replay, length, blobs, budget);
+        !result) {
+      return std::unexpected(result.error());
+    }
+
+    if (!budget.take<Input>(length)) {
+      return std::unexpected(ReplayError::MemoryBudgetError);
+    }
+
+    replay.m_inputs.resize(length);
+
+    uint64_t dataSize = 0;
+    for (const auto &blob : blobs) {
+      dataSize += blob.minDataSize();
+    }
+
+    uint64_t frame = 0;
+    _Blob::ReadBuffer buffer(dataSize);
+
+    for (const auto &blob : blobs) {
+      blob.read(s, replay.m_inputs, frame, buffer);
+    }
+
+    if (auto result = readFooter(s); !result) {
+      return std::unexpected(result.error());
+    }
+
+    return replay;
+  }
+
+  /**
+   * Read a replay from a stream without storing its inputs.
+   *
+   * `onHeader` is called once the TPS and meta are known, then every input is
+   * passed to `onInput` in order as soon as it's decoded. The returned replay
+   * only holds the TPS and the meta. Memory use doesn't depend on the length
+   * of the replay.
+   *
+   * # Errors
+   * - HeaderMismatchError if the header doesn't match
+   * - MetaSizeMismatchError if the meta's size doesn't match
+   * - MalformedBlobError if the blob table doesn't cover the inputs exactly
+   * - UnexpectedEndError if the stream is too short for what it declares
+   * - FooterMismatchError if the footer doesn't match
+   */
+  template <typename H, typename F>
+    requires std::invocable<H &, const Self &> &&
+             std::invocable<F &, const Input &>
+  [[nodiscard]]
+  static std::expected<Self, ReplayError> stream(std::istream &s, H &&onHeader,
+                                                 F &&onInput) {
     Self replay;
+    uint64_t length = 0;
+    std::vector<_Blob> blobs;
+    MemoryBudget budget;
+
+    if (auto result = readPreamble(s, replay, length, blobs, budget);
+        !result) {
+      return std::unexpected(result.error());
+    }
+
+    onHeader(static_cast<const Self &>(replay));
+
+    uint64_t frame = 0;
+
+    for (const auto &blob : blobs) {
+      blob.stream(s, frame, onInput);
+    }
+
+    if (auto result = readFooter(s); !result) {
+      return std::unexpected(result.error());
+    }
+
+    return replay;
+  }
+
+private:
+  static std::expected<void, ReplayError>
+  readPreamble(std::istream &s, Self &replay, uint64_t &length,
+               std::vector<_Blob> &blobs, MemoryBudget &budget) {
     char header[4];
     s.read(header, sizeof(header));
     if (memcmp(header, HEADER, sizeof(header)) != 0) {
@@ -390,129 +974,865 @@ public:
       replay.m_meta = util::binRead<Meta>(s);
     }
 
-    uint64_t length = util::binRead<uint64_t>(s);
-    replay.m_inputs.resize(length);
+    length = util::binRead<uint64_t>(s);
 
     uint64_t blobCount = util::binRead<uint64_t>(s);
 
-    std::vector<_Blob> blobs(blobCount);
-    for (auto &blob : blobs) {
-      blob = _Blob::readFromMeta(s);
+    // Counts are checked against what's left of the stream before anything
+    // is allocated for them. For streams that can't tell, the table only
+    // grows as its entries are actually read
+    const auto remaining = util::remainingSize(s);
+    if (!s || (remaining && blobCount > *remaining / _Blob::META_SIZE)) {
+      return std::unexpected(ReplayError::UnexpectedEndError);
     }
 
-    uint64_t frame = 0;
+    // Every blob holds at least one input
+    if (blobCount > length) {
+      return std::unexpected(ReplayError::MalformedBlobError);
+    }
+
+    if (!budget.take<_Blob>(blobCount)) {
+      return std::unexpected(ReplayError::MemoryBudgetError);
+    }
+
+    uint64_t inputBytes =
+        remaining ? *remaining - blobCount * _Blob::META_SIZE : UINT64_MAX;
+    uint64_t expectedStart = 0;
+
+    // The table is read a chunk at a time rather than field by field, since
+    // blobs are usually short and there are a lot of them
+    constexpr size_t TABLE_CHUNK = 256;
+    std::array<uint64_t, 3 * TABLE_CHUNK> table;
+
+    if (remaining) {
+      blobs.reserve(blobCount);
+    }
 
     for (uint64_t i = 0; i < blobCount; i++) {
-      blobs.at(i).read(s, replay.m_inputs, frame);
+      if (i % TABLE_CHUNK == 0) {
+        const size_t count = std::min<uint64_t>(blobCount - i, TABLE_CHUNK);
+        s.read(reinterpret_cast<char *>(table.data()),
+               count * _Blob::META_SIZE);
+        if (!s) {
+          return std::unexpected(ReplayError::UnexpectedEndError);
+        }
+
+        blobs.resize(i + count);
+      }
+
+      _Blob &blob = blobs[i];
+      const uint64_t *fields = &table[3 * (i % TABLE_CHUNK)];
+      blob.m_byteSize = fields[0];
+      blob.m_start = fields[1];
+      blob.m_length = fields[2];
+
+      if (blob.m_byteSize == 0 || blob.m_byteSize > sizeof(uint64_t) ||
+          blob.m_start != expectedStart || blob.m_length == 0 ||
+          blob.m_length > length - blob.m_start) {
+        return std::unexpected(ReplayError::MalformedBlobError);
+      }
+
+      // Every input takes up at least its byte size
+      if (blob.m_length > inputBytes / blob.m_byteSize) {
+        return std::unexpected(ReplayError::UnexpectedEndError);
+      }
+
+      inputBytes -= blob.m_length * blob.m_byteSize;
+      expectedStart += blob.m_length;
+    }
+
+    if (expectedStart != length) {
+      return std::unexpected(ReplayError::MalformedBlobError);
     }
 
+    return {};
+  }
+
+  static std::expected<void, ReplayError> readFooter(std::istream &s) {
     char footer[3];
     s.read(footer, sizeof(footer));
-    if (memcmp(footer, FOOTER, sizeof(footer)) != 0) {
+    if (!s || memcmp(footer, FOOTER, sizeof(footer)) != 0) {
       return std::unexpected(ReplayError::FooterMismatchError);
     }
 
-    return replay;
+    return {};
   }
 
+public:
   /**
    * Save a replay to a stream.
    * Empty replays are supported.
    */
   void write(std::ostream &s) {
-    s.write(HEADER, 4);
-    util::binWrite(s, this->m_tps);
+    writeHeader(s, this->m_tps, *this, this->m_inputs.size());
 
-    if constexpr (std::is_void_v<Meta>) {
-      util::binWrite(s, static_cast<uint64_t>(0));
-    } else {
-      util::binWrite(s, static_cast<uint64_t>(sizeof(Meta)));
-      util::binWrite(s, this->m_meta);
-    }
+    auto blobs = _Blob::partition(this->m_inputs.size(), [&](uint64_t i) {
+      return this->m_inputs[i].requiredBytes();
+    });
 
-    util::binWrite(s, static_cast<uint64_t>(this->m_inputs.size()));
+    writeBlobs(s, blobs, [&](const _Blob &blob) { blob.write(s, m_inputs); });
 
-    // Can't preallocate memory here unfortunately; since blobs
-    // are highly dynamic and one input can change the blob count, this
-    // vector unfortunately has to be allocated along with elements being added.
-    //
-    // What's very unfun with this system is that, in theory, a perfectly
-    // crafted macro with size-1, size-2, size-4 and size-8 inputs consecutively
-    // will take up more space than a typical macro. This scenario is so
-    // incredibly unlikely, that it's worth the tradeoff.
-    std::vector<_Blob> blobs;
-    for (size_t i = 0; i < this->m_inputs.size(); i++) {
-      const auto &input = this->m_inputs.at(i);
-      uint8_t inputSize = input.requiredBytes();
+    s.write(FOOTER, 3);
+  }
 
-      if (blobs.empty()) {
-        blobs.push_back(_Blob(inputSize, i));
-        continue;
-      }
+  /**
+   * Save packed input states as a replay, without going through [`Input`].
+   *
+   * `tpsValues` holds the TPS of every TPS input, in the order they appear
+   * in `states`. Empty replays are supported.
+   */
+  static void writeStates(std::ostream &s, double tps,
+                          const MetaContainer<Meta> &meta,
+                          std::span<const uint64_t> states,
+                          std::span<const double> tpsValues) {
+    StateWriter writer(s, tps, meta,
+                       _Blob::partition(states.size(), [&](uint64_t i) {
+                         return Input::requiredBytes(states[i]);
+                       }));
+
+    size_t nextTps = 0;
+    for (const uint64_t state : states) {
+      const bool isTPS = Input::isTPS(state) && nextTps < tpsValues.size();
+      writer.push(state, isTPS ? tpsValues[nextTps++] : 0.0);
+    }
 
-      auto &blob = blobs.at(blobs.size() - 1);
+    writer.finish();
+  }
 
-      if (blob.m_byteSize < inputSize) {
-        blobs.push_back(_Blob(inputSize, i));
-        continue;
-      } else if (blob.m_byteSize > inputSize) {
-        // Adding a blob is more expensive than adding a new 64bit input.
-        // We naively add blobs here to later clean them up in the second pass.
+  /**
+   * Writes packed input states as a replay one at a time, so they don't all
+   * have to be in memory at once.
+   *
+   * The blobs have to be known up front, since their table comes before the
+   * inputs; they can be found in a first pass over the states with a
+   * [`_Blob::Partitioner`]. Exactly as many states as the blobs hold have to
+   * be pushed before calling [`finish`].
+   */
+  class StateWriter {
+  private:
+    std::ostream &m_out;
+    std::vector<_Blob> m_blobs;
+    size_t m_blob = 0;
+    uint64_t m_index = 0;
+
+  public:
+    StateWriter(std::ostream &s, double tps, const MetaContainer<Meta> &meta,
+                std::vector<_Blob> blobs)
+        : m_out(s), m_blobs(std::move(blobs)) {
+      const uint64_t length =
+          m_blobs.empty() ? 0 : m_blobs.back().m_start + m_blobs.back().m_length;
+
+      writeHeader(s, tps, meta, length);
+      writeBlobs(s, m_blobs, [](const _Blob &) {});
+    }
 
-        blobs.push_back(_Blob(inputSize, i));
-        continue;
-      } else {
-        blob.m_length++;
-      }
-    }
-
-    size_t zeroSizedBlobs = 0;
-
-    // Second pass; consolidates blobs into prior blobs that are too small
-    // (a new blob for one 1-byte input is more expensive than adding that input
-    // to an 8-byte blob)
-    for (size_t i = blobs.size() - 1; i > 0; i--) {
-      uint64_t blobSize = blobs[i].m_byteSize * blobs[i].m_length;
-
-      if (blobSize < sizeof(_Blob)) {
-        // Blobs with length 0 are empty blobs, and won't be written to the
-        // file.
-        if (blobs[i].m_byteSize > blobs[i - 1].m_byteSize &&
-            blobs[i - 1].m_byteSize * blobs[i].m_length < sizeof(_Blob)) {
-          blobs[i - 1].m_length += blobs[i].m_length;
-          blobs[i - 1].m_byteSize = blobs[i].m_byteSize;
-          blobs[i].m_length = 0;
-          zeroSizedBlobs++;
-          continue;
-        } else if (blobs[i].m_byteSize < blobs[i - 1].m_byteSize &&
-                   blobs[i - 1].m_byteSize * blobs[i].m_length <
-                       sizeof(_Blob)) {
-          blobs[i - 1].m_length += blobs[i].m_length;
-          blobs[i].m_length = 0;
-          zeroSizedBlobs++;
-          continue;
-        }
+    /**
+     * Write the next state; `tps` is only saved for TPS inputs.
+     */
+    void push(uint64_t state, double tps) {
+      while (m_index >= m_blobs[m_blob].m_start + m_blobs[m_blob].m_length) {
+        m_blob++;
       }
 
-      if (blobs[i].m_byteSize == blobs[i - 1].m_byteSize) {
-        blobs[i - 1].m_length += blobs[i].m_length;
-        blobs[i].m_length = 0;
-        zeroSizedBlobs++;
-      }
+      m_blobs[m_blob].writeInput(m_out, state, [&] { return tps; });
+      m_index++;
     }
 
-    util::binWrite(s, static_cast<uint64_t>(blobs.size() - zeroSizedBlobs));
+    void finish() { m_out.write(FOOTER, 3); }
+  };
 
-    // horrible for the economy
+private:
+  static void writeHeader(std::ostream &s, double tps,
+                          const MetaContainer<Meta> &meta, uint64_t length) {
+    s.write(HEADER, 4);
+    util::binWrite(s, tps);
+
+    if constexpr (std::is_void_v<Meta>) {
+      util::binWrite(s, static_cast<uint64_t>(0));
+    } else {
+      util::binWrite(s, static_cast<uint64_t>(sizeof(Meta)));
+      util::binWrite(s, meta.m_meta);
+    }
+
+    util::binWrite(s, length);
+  }
+
+  template <typename F>
+  static void writeBlobs(std::ostream &s, const std::vector<_Blob> &blobs,
+                         F &&writeBlob) {
+    const uint64_t blobCount =
+        std::count_if(blobs.begin(), blobs.end(),
+                      [](const _Blob &blob) { return blob.m_length > 0; });
+
+    util::binWrite(s, blobCount);
+
+    // horrible for the economy
     for (const auto &blob : blobs) {
       blob.writeMeta(s);
     }
 
     for (const auto &blob : blobs) {
-      blob.write(s, this->m_inputs);
+      writeBlob(blob);
     }
+  }
+};
 
-    s.write(FOOTER, 3);
+/**
+ * A read-only view over a saved replay.
+ *
+ * Nothing is decoded up front; inputs are read straight out of the given
+ * buffer (which can just as well be a memory mapped file) by locating them
+ * through the blob table, so looking up the state of an input by index takes
+ * O(log blobs). Frames are found through a sparse index of frame checkpoints,
+ * which is built lazily as far as lookups need it: the first lookup past the
+ * end of the index walks every input up to it. Once [`buildFrameIndex`] has
+ * been called, [`frame`], [`input`] and [`lowerBound`] take
+ * O(log length + FRAME_STRIDE).
+ *
+ * The buffer has to outlive the view. Since lookups may extend the frame
+ * index, a view should only be shared between threads after
+ * [`buildFrameIndex`] has been called.
+ */
+template <typename M = void> class ReplayView {
+private:
+  using Meta = M;
+  using Self = ReplayView<Meta>;
+  using Format = Replay<Meta>;
+
+  // How many inputs there are between two frame checkpoints.
+  static constexpr uint64_t FRAME_STRIDE = 1024;
+  static constexpr size_t BLOB_META_SIZE = _Blob::META_SIZE;
+  static constexpr size_t META_OFFSET = 4 + sizeof(double) + sizeof(uint64_t);
+
+  std::span<const uint8_t> m_data;
+  double m_tps = 0.0;
+  uint64_t m_length = 0;
+  uint64_t m_blobCount = 0;
+  size_t m_blobTable = 0;
+
+  // Where the data of every blob starts in the buffer.
+  std::vector<uint64_t> m_blobOffsets;
+  // Indices of all TPS inputs in ascending order; their trailing TPS is the
+  // only thing that keeps offsets in blobs from being computed directly.
+  std::vector<uint64_t> m_tpsInputs;
+  // The frame of the input right before every checkpoint.
+  mutable std::vector<uint64_t> m_frames = {0};
+
+  template <typename T> T load(size_t offset) const {
+    T value;
+    std::memcpy(&value, m_data.data() + offset, sizeof(T));
+    return value;
+  }
+
+  _Blob blob(uint64_t index) const {
+    const size_t offset = m_blobTable + index * BLOB_META_SIZE;
+
+    _Blob b;
+    b.m_byteSize = load<uint64_t>(offset);
+    b.m_start = load<uint64_t>(offset + sizeof(uint64_t));
+    b.m_length = load<uint64_t>(offset + 2 * sizeof(uint64_t));
+    return b;
+  }
+
+  uint64_t blobIndex(uint64_t input) const {
+    uint64_t low = 0, high = m_blobCount;
+    while (high - low > 1) {
+      const uint64_t mid = low + (high - low) / 2;
+      if (blob(mid).m_start <= input) {
+        low = mid;
+      } else {
+        high = mid;
+      }
+    }
+
+    return low;
+  }
+
+  uint64_t tpsBetween(uint64_t first, uint64_t last) const {
+    return std::lower_bound(m_tpsInputs.begin(), m_tpsInputs.end(), last) -
+           std::lower_bound(m_tpsInputs.begin(), m_tpsInputs.end(), first);
+  }
+
+  size_t offsetOf(uint64_t index, const _Blob &b, uint64_t blobIdx) const {
+    return m_blobOffsets[blobIdx] + (index - b.m_start) * b.m_byteSize +
+           sizeof(double) * tpsBetween(b.m_start, index);
+  }
+
+  /**
+   * Call `f(index, state, frame, end)` for inputs `[first, last)` in order,
+   * until it returns false. `frame` is the frame of the input before `first`,
+   * and `end` is the offset right after the state, where the TPS of a TPS
+   * input is.
+   */
+  template <typename F>
+  void walk(uint64_t first, uint64_t last, uint64_t frame, F &&f) const {
+    if (first >= last) {
+      return;
+    }
+
+    uint64_t blobIdx = blobIndex(first);
+    _Blob b = blob(blobIdx);
+    size_t offset = offsetOf(first, b, blobIdx);
+
+    for (uint64_t i = first; i < last; i++) {
+      if (i >= b.m_start + b.m_length) {
+        b = blob(++blobIdx);
+        offset = m_blobOffsets[blobIdx];
+      }
+
+      uint64_t state = 0;
+      std::memcpy(&state, m_data.data() + offset, b.m_byteSize);
+      frame += state >> 5;
+      offset += b.m_byteSize;
+
+      if (!f(i, state, frame, offset)) {
+        return;
+      }
+
+      if (Input::isTPS(state)) {
+        offset += sizeof(double);
+      }
+    }
+  }
+
+  void extendFrameIndex(uint64_t checkpoint) const {
+    while (m_frames.size() <= checkpoint) {
+      const uint64_t start = (m_frames.size() - 1) * FRAME_STRIDE;
+      uint64_t frame = m_frames.back();
+
+      walk(start, start + FRAME_STRIDE, frame,
+           [&](uint64_t, uint64_t, uint64_t f, size_t) {
+             frame = f;
+             return true;
+           });
+
+      m_frames.push_back(frame);
+    }
+  }
+
+  uint64_t checkpointCount() const {
+    return m_length == 0 ? 1 : (m_length - 1) / FRAME_STRIDE + 1;
+  }
+
+public:
+  /**
+   * Open a view over a saved replay.
+   *
+   * The header and the blob table are validated, and the blob offsets are
+   * computed; this looks at every state once, since TPS inputs (in blobs of
+   * any width) are followed by their TPS.
+   *
+   * # Errors
+   * - HeaderMismatchError if the header doesn't match
+   * - MetaSizeMismatchError if the meta's size doesn't match
+   * - MalformedBlobError if the blob table doesn't cover the inputs exactly
+   * - UnexpectedEndError if the buffer is too short for what it declares
+   * - FooterMismatchError if the footer doesn't match
+   */
+  [[nodiscard]]
+  static std::expected<Self, ReplayError> open(std::span<const uint8_t> data) {
+    Self view;
+    view.m_data = data;
+
+    if (data.size() < META_OFFSET) {
+      return std::unexpected(ReplayError::UnexpectedEndError);
+    }
+
+    if (memcmp(data.data(), Format::HEADER, 4) != 0) {
+      return std::unexpected(ReplayError::HeaderMismatchError);
+    }
+
+    view.m_tps = view.template load<double>(4);
+    const uint64_t metaSize = view.template load<uint64_t>(4 + sizeof(double));
+
+    if constexpr (std::is_void_v<Meta>) {
+      if (metaSize != 0) {
+        return std::unexpected(ReplayError::MetaSizeMismatchError);
+      }
+    } else {
+      if (metaSize != sizeof(Meta)) {
+        return std::unexpected(ReplayError::MetaSizeMismatchError);
+      }
+    }
+
+    size_t pos = META_OFFSET + metaSize;
+    if (data.size() < pos + 2 * sizeof(uint64_t)) {
+      return std::unexpected(ReplayError::UnexpectedEndError);
+    }
+
+    view.m_length = view.template load<uint64_t>(pos);
+    view.m_blobCount = view.template load<uint64_t>(pos + sizeof(uint64_t));
+    pos += 2 * sizeof(uint64_t);
+
+    if (view.m_blobCount > (data.size() - pos) / BLOB_META_SIZE) {
+      return std::unexpected(ReplayError::UnexpectedEndError);
+    }
+
+    view.m_blobTable = pos;
+    pos += view.m_blobCount * BLOB_META_SIZE;
+
+    view.m_blobOffsets.reserve(view.m_blobCount);
+
+    uint64_t expectedStart = 0;
+    for (uint64_t i = 0; i < view.m_blobCount; i++) {
+      const _Blob b = view.blob(i);
+
+      if (!std::has_single_bit(b.m_byteSize) || b.m_byteSize > 8 ||
+          b.m_start != expectedStart || b.m_length == 0 ||
+          b.m_length > view.m_length - b.m_start) {
+        return std::unexpected(ReplayError::MalformedBlobError);
+      }
+
+      expectedStart += b.m_length;
+      view.m_blobOffsets.push_back(pos);
+
+      if (b.m_length > (data.size() - pos) / b.m_byteSize) {
+        return std::unexpected(ReplayError::UnexpectedEndError);
+      }
+
+      for (uint64_t j = 0; j < b.m_length; j++) {
+        if (data.size() - pos < b.m_byteSize) {
+          return std::unexpected(ReplayError::UnexpectedEndError);
+        }
+
+        uint64_t state = 0;
+        std::memcpy(&state, data.data() + pos, b.m_byteSize);
+        pos += b.m_byteSize;
+
+        if (Input::isTPS(state)) {
+          if (data.size() - pos < sizeof(double)) {
+            return std::unexpected(ReplayError::UnexpectedEndError);
+          }
+
+          view.m_tpsInputs.push_back(b.m_start + j);
+          pos += sizeof(double);
+        }
+      }
+    }
+
+    if (expectedStart != view.m_length) {
+      return std::unexpected(ReplayError::MalformedBlobError);
+    }
+
+    if (data.size() - pos < 3 ||
+        memcmp(data.data() + pos, Format::FOOTER, 3) != 0) {
+      return std::unexpected(ReplayError::FooterMismatchError);
+    }
+
+    return view;
+  }
+
+  double tps() const { return m_tps; }
+
+  /**
+   * Get a copy of the replay meta.
+   */
+  Meta meta() const
+    requires(!std::is_void_v<Meta>)
+  {
+    return load<Meta>(META_OFFSET);
+  }
+
+  /**
+   * Get the length of the replay.
+   */
+  size_t length() const { return m_length; }
+
+  /**
+   * Get the packed state of an input.
+   */
+  uint64_t state(uint64_t index) const {
+    assert(index < m_length);
+
+    const uint64_t blobIdx = blobIndex(index);
+    const _Blob b = blob(blobIdx);
+
+    uint64_t state = 0;
+    std::memcpy(&state, m_data.data() + offsetOf(index, b, blobIdx),
+                b.m_byteSize);
+    return state;
+  }
+
+  /**
+   * Get the frame an input happens on.
+   */
+  uint64_t frame(uint64_t index) const {
+    assert(index < m_length);
+
+    const uint64_t checkpoint = index / FRAME_STRIDE;
+    extendFrameIndex(checkpoint);
+
+    uint64_t frame = m_frames[checkpoint];
+    walk(checkpoint * FRAME_STRIDE, index + 1, frame,
+         [&](uint64_t, uint64_t, uint64_t f, size_t) {
+           frame = f;
+           return true;
+         });
+
+    return frame;
+  }
+
+  /**
+   * Get an input, with all of its helper fields filled in.
+   */
+  Input input(uint64_t index) const {
+    assert(index < m_length);
+
+    const uint64_t blobIdx = blobIndex(index);
+    const _Blob b = blob(blobIdx);
+    const size_t offset = offsetOf(index, b, blobIdx);
+
+    uint64_t state = 0;
+    std::memcpy(&state, m_data.data() + offset, b.m_byteSize);
+
+    const double tps = Input::isTPS(state)
+                           ? load<double>(offset + b.m_byteSize)
+                           : 0.0;
+
+    return Input::fromState(state, frame(index) - (state >> 5), tps);
+  }
+
+  /**
+   * Call `f` with every input in `[first, last)`, in order.
+   * This is much faster than calling [`input`] for every index.
+   */
+  template <typename F>
+    requires std::invocable<F &, const Input &>
+  void forEach(uint64_t first, uint64_t last, F &&f) const {
+    last = std::min<uint64_t>(last, m_length);
+    if (first >= last) {
+      return;
+    }
+
+    const uint64_t base = first == 0 ? 0 : frame(first - 1);
+
+    walk(first, last, base,
+         [&](uint64_t, uint64_t state, uint64_t frame, size_t end) {
+           const double tps = Input::isTPS(state) ? load<double>(end) : 0.0;
+
+           f(Input::fromState(state, frame - (state >> 5), tps));
+           return true;
+         });
+  }
+
+  /**
+   * Find the index of the first input on or after a frame.
+   * Returns the length of the replay if there is none.
+   */
+  size_t lowerBound(uint64_t frame) const {
+    if (m_length == 0) {
+      return 0;
+    }
+
+    // The index only has to reach the first checkpoint at or past `frame`
+    const uint64_t count = checkpointCount();
+    while (m_frames.size() < count && m_frames.back() < frame) {
+      extendFrameIndex(m_frames.size());
+    }
+
+    // m_frames[k] is the frame of input k * FRAME_STRIDE - 1, so the first
+    // checkpoint at or past `frame` bounds the search from above
+    auto it = std::lower_bound(m_frames.begin() + 1, m_frames.end(), frame);
+    const uint64_t checkpoint = it - m_frames.begin();
+
+    const uint64_t first = (checkpoint - 1) * FRAME_STRIDE;
+    const uint64_t last =
+        std::min<uint64_t>(checkpoint * FRAME_STRIDE, m_length);
+
+    size_t result = last;
+    walk(first, last, m_frames[checkpoint - 1],
+         [&](uint64_t i, uint64_t, uint64_t f, size_t) {
+           if (f >= frame) {
+             result = i;
+             return false;
+           }
+
+           return true;
+         });
+
+    return result;
+  }
+
+  /**
+   * Build the whole frame index up front.
+   */
+  void buildFrameIndex() const { extendFrameIndex(checkpointCount() - 1); }
+};
+
+/**
+ * A replay that's kept in memory in its packed form.
+ *
+ * [`Replay`] keeps a full [`Input`] per input, which is about five times the
+ * size of the packed state it's made from. This only keeps the packed states,
+ * the TPS of TPS inputs in a side table, and the frame of every
+ * `FRAME_STRIDE`th input; frames and helper fields are computed when an input
+ * is accessed. Frame lookups take O(FRAME_STRIDE).
+ *
+ * The file format is exactly the same as [`Replay`]'s.
+ */
+template <typename M = void> class CompactReplay : public MetaContainer<M> {
+private:
+  using Meta = M;
+  using Self = CompactReplay<Meta>;
+  using Format = Replay<Meta>;
+
+public:
+  // How many inputs there are between two frame checkpoints.
+  static constexpr uint64_t FRAME_STRIDE = 256;
+
+  using ReplayError = v2::ReplayError;
+
+private:
+  std::vector<uint64_t> m_states;
+  // Indices of all TPS inputs in ascending order, along with their TPS
+  std::vector<uint64_t> m_tpsInputs;
+  std::vector<double> m_tpsValues;
+  // The frame of the input right before every checkpoint
+  std::vector<uint64_t> m_frames = {0};
+  uint64_t m_lastFrame = 0;
+
+  void push(uint64_t state, uint64_t frame) {
+    if (!m_states.empty() && m_states.size() % FRAME_STRIDE == 0) {
+      m_frames.push_back(m_lastFrame);
+    }
+
+    m_states.push_back(state);
+    m_lastFrame = frame;
+  }
+
+  double tpsOf(uint64_t index) const {
+    auto it = std::lower_bound(m_tpsInputs.begin(), m_tpsInputs.end(), index);
+    return m_tpsValues[it - m_tpsInputs.begin()];
+  }
+
+public:
+  double m_tps = 240.0;
+
+  /**
+   * Add an input to the replay.
+   *
+   * Do not use this to add TPS changing (`Input::InputType::TPS`) inputs, use
+   * [`addTPSInput`] instead.
+   *
+   * # Errors
+   * - IncorrectFrameError if the frame that's being added is earlier than the
+   * frame of the last input.
+   * - Throws a runtime error if the method is used to add a TPS input.
+   */
+  std::expected<void, ReplayError> addInput(const uint64_t frame,
+                                            const Input::InputType type,
+                                            const bool p2, const bool hold) {
+    if (frame < m_lastFrame) {
+      return std::unexpected(ReplayError::IncorrectFrameError);
+    }
+
+    if (type == Input::InputType::TPS) {
+      throw std::runtime_error("TPS inputs must be added with addTPSInput.");
+    }
+
+    push(Input::packState(frame - m_lastFrame, type, p2, hold), frame);
+
+    return {};
+  }
+
+  /**
+   * Add a TPS change input to the replay.
+   *
+   * # Errors
+   * - IncorrectFrameError if the frame that's being added is earlier than the
+   * frame of the last input.
+   */
+  std::expected<void, ReplayError> addTPSInput(const uint64_t frame,
+                                               const double tps) {
+    if (frame < m_lastFrame) {
+      return std::unexpected(ReplayError::IncorrectFrameError);
+    }
+
+    m_tpsInputs.push_back(m_states.size());
+    m_tpsValues.push_back(tps);
+
+    push(Input::packState(frame - m_lastFrame, Input::InputType::TPS, false,
+                          false),
+         frame);
+
+    return {};
+  }
+
+  /**
+   * Remove the last input from the replay.
+   */
+  void popInput() { truncate(m_states.size() - 1); }
+
+  /**
+   * Remove all inputs from the replay.
+   */
+  void clearInputs() { truncate(0); }
+
+  /**
+   * Remove all inputs on or after a specified frame.
+   *
+   * The important thng to note here that the method also removes
+   * inputs that happen on the same frame as `frame`.
+   */
+  void pruneAfterFrame(const uint64_t frame) { truncate(lowerBound(frame)); }
+
+  /**
+   * Keep only the first `length` inputs.
+   */
+  void truncate(size_t length) {
+    if (length >= m_states.size()) {
+      return;
+    }
+
+    const uint64_t lastFrame = length == 0 ? 0 : frame(length - 1);
+
+    auto tps = std::lower_bound(m_tpsInputs.begin(), m_tpsInputs.end(), length);
+    m_tpsValues.resize(tps - m_tpsInputs.begin());
+    m_tpsInputs.erase(tps, m_tpsInputs.end());
+
+    m_states.resize(length);
+    m_frames.resize(length == 0 ? 1 : (length - 1) / FRAME_STRIDE + 1);
+    m_lastFrame = lastFrame;
+  }
+
+  /**
+   * Get the length of the replay.
+   */
+  size_t length() const { return m_states.size(); }
+
+  /**
+   * Get the packed state of an input.
+   */
+  uint64_t state(uint64_t index) const { return m_states.at(index); }
+
+  /**
+   * Get the packed states of all inputs.
+   */
+  std::span<const uint64_t> states() const { return m_states; }
+
+  /**
+   * Get the frame an input happens on.
+   */
+  uint64_t frame(uint64_t index) const {
+    assert(index < m_states.size());
+
+    const uint64_t checkpoint = index / FRAME_STRIDE;
+    uint64_t frame = m_frames[checkpoint];
+
+    for (uint64_t i = checkpoint * FRAME_STRIDE; i <= index; i++) {
+      frame += m_states[i] >> 5;
+    }
+
+    return frame;
+  }
+
+  /**
+   * Get an input, with all of its helper fields filled in.
+   */
+  Input input(uint64_t index) const {
+    const uint64_t state = m_states.at(index);
+
+    return Input::fromState(state, frame(index) - (state >> 5),
+                            Input::isTPS(state) ? tpsOf(index) : 0.0);
+  }
+
+  /**
+   * Call `f` with every input in `[first, last)`, in order.
+   * This is much faster than calling [`input`] for every index.
+   */
+  template <typename F>
+    requires std::invocable<F &, const Input &>
+  void forEach(uint64_t first, uint64_t last, F &&f) const {
+    last = std::min<uint64_t>(last, m_states.size());
+    if (first >= last) {
+      return;
+    }
+
+    uint64_t frame = first == 0 ? 0 : this->frame(first - 1);
+    auto tps = std::lower_bound(m_tpsInputs.begin(), m_tpsInputs.end(), first);
+
+    for (uint64_t i = first; i < last; i++) {
+      const uint64_t state = m_states[i];
+      double value = 0.0;
+
+      if (Input::isTPS(state)) {
+        value = m_tpsValues[tps - m_tpsInputs.begin()];
+        tps++;
+      }
+
+      f(Input::fromState(state, frame, value));
+      frame += state >> 5;
+    }
+  }
+
+  /**
+   * Find the index of the first input on or after a frame.
+   * Returns the length of the replay if there is none.
+   */
+  size_t lowerBound(uint64_t frame) const {
+    if (m_states.empty() || m_lastFrame < frame) {
+      return m_states.size();
+    }
+
+    // m_frames[k] is the frame of input k * FRAME_STRIDE - 1, so the last
+    // checkpoint before `frame` is where the search starts
+    auto it = std::lower_bound(m_frames.begin() + 1, m_frames.end(), frame);
+    const uint64_t checkpoint = (it - m_frames.begin()) - 1;
+
+    uint64_t current = m_frames[checkpoint];
+    for (uint64_t i = checkpoint * FRAME_STRIDE; i < m_states.size(); i++) {
+      current += m_states[i] >> 5;
+      if (current >= frame) {
+        return i;
+      }
+    }
+
+    return m_states.size();
+  }
+
+  /**
+   * Read a replay from a stream.
+   * Inputs are packed as they're decoded; no [`Input`] vector is built.
+   *
+   * # Errors
+   * - HeaderMismatchError if the header doesn't match
+   * - MetaSizeMismatchError if the meta's size doesn't match
+   * - FooterMismatchError if the footer doesn't match
+   */
+  [[nodiscard]]
+  static std::expected<Self, ReplayError> read(std::istream &s) {
+    Self replay;
+
+    const auto onHeader = [&](const Format &format) {
+      replay.m_tps = format.m_tps;
+
+      if constexpr (!std::is_void_v<Meta>) {
+        replay.m_meta = format.m_meta;
+      }
+    };
+
+    const auto onInput = [&](const Input &input) {
+      if (input.m_button == Input::InputType::TPS) {
+        replay.m_tpsInputs.push_back(replay.m_states.size());
+        replay.m_tpsValues.push_back(input.m_tps);
+      }
+
+      replay.push(input.state(), input.m_frame);
+    };
+
+    if (auto result = Format::stream(s, onHeader, onInput); !result) {
+      return std::unexpected(result.error());
+    }
+
+    return replay;
+  }
+
+  /**
+   * Save a replay to a stream.
+   * Empty replays are supported.
+   */
+  void write(std::ostream &s) const {
+    Format::writeStates(s, m_tps, *this, m_states, m_tpsValues);
   }
 };
 
@@ -1,6 +1,11 @@
 #ifndef SLC_FORMATS_V3_HPP
 #define SLC_FORMATS_V3_HPP
 
+#include "slc/formats/v3/decoder.hpp"
+#include "slc/formats/v3/encoder.hpp"
+#include "slc/formats/v3/merge.hpp"
+#include "slc/formats/v3/reorder.hpp"
 #include "slc/formats/v3/replay.hpp"
+#include "slc/formats/v3/validate.hpp"
 
 #endif // SLC_FORMATS_V3_HPP
@@ -1,13 +1,16 @@
 #ifndef _SLC_V3_ATOM_HPP
 #define _SLC_V3_ATOM_HPP
 
+#include "slc/formats/v3/checksum.hpp"
 #include "slc/formats/v3/error.hpp"
 #include "slc/util.hpp"
 
+#include <algorithm>
 #include <array>
 #include <concepts>
 #include <ostream>
 #include <type_traits>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -15,12 +18,59 @@ SLC_NS_BEGIN
 
 namespace v3 {
 
+/**
+ * Builtin atom ids. Custom atoms can use any other id; registries don't need
+ * ids to be contiguous.
+ */
 enum class AtomId : uint32_t {
   Null = 0,
   Action = 1,
   Marker = 2,
 };
 
+/**
+ * Per-atom flags, stored in the top 8 bits of the atom size.
+ *
+ * The low 4 bits are feature bits, the high 4 bits are the version of the
+ * encoding the payload uses. Flags let atoms use other encodings of their
+ * payload without needing a new atom id; readers skip atoms whose flags they
+ * don't support, the same way they skip atoms with an unknown id.
+ */
+struct AtomFlags {
+  enum Feature : uint8_t {
+    // The payload is entropy coded.
+    Compressed = 1 << 0,
+    // The payload carries an index for seeking.
+    Indexed = 1 << 1,
+    // The payload is followed by its CRC32C, which is counted in the atom
+    // size. Handled by the atom serializer; atoms never see this flag.
+    Checksummed = 1 << 2,
+    // The payload stores the inputs of each player in a stream of their own.
+    Split = 1 << 3,
+  };
+
+  static constexpr uint8_t FEATURE_MASK = 0x0F;
+  static constexpr uint8_t MAX_VERSION = 0x0F;
+
+  uint8_t m_features = 0;
+  uint8_t m_version = 0;
+
+  static constexpr AtomFlags unpack(uint8_t flags) {
+    return AtomFlags{.m_features = static_cast<uint8_t>(flags & FEATURE_MASK),
+                     .m_version = static_cast<uint8_t>(flags >> 4)};
+  }
+
+  constexpr uint8_t pack() const {
+    return static_cast<uint8_t>((m_version << 4) | (m_features & FEATURE_MASK));
+  }
+
+  constexpr bool has(Feature feature) const {
+    return (m_features & feature) != 0;
+  }
+
+  constexpr bool operator==(const AtomFlags &) const = default;
+};
+
 template <typename T>
 concept IsAtom =
     requires(T &t, std::istream &is, std::ostream &os, size_t size) {
@@ -31,6 +81,34 @@ concept IsAtom =
       { T::read(is, size) } -> std::same_as<Result<T>>;
     };
 
+/**
+ * An atom that uses atom flags.
+ *
+ * `flags` returns the flags the atom will be written with, and `supports`
+ * tells whether a payload with given flags can be read. Atoms that don't use
+ * flags are only read when all flags are clear.
+ */
+template <typename T>
+concept HasAtomFlags =
+    IsAtom<T> &&
+    requires(const T &t, std::istream &is, size_t size, AtomFlags flags) {
+      { t.flags() } -> std::same_as<AtomFlags>;
+      { T::supports(flags) } -> std::convertible_to<bool>;
+      { T::read(is, size, flags) } -> std::same_as<Result<T>>;
+    };
+
+/**
+ * An atom that allocates according to sizes or counts in its payload, and
+ * accounts for that against the memory budget of the read. See
+ * [`ReadOptions`].
+ */
+template <typename T>
+concept HasBudgetedRead =
+    HasAtomFlags<T> && requires(std::istream &is, size_t size, AtomFlags flags,
+                                MemoryBudget &budget) {
+      { T::read(is, size, flags, budget) } -> std::same_as<Result<T>>;
+    };
+
 struct NullAtom {
   static inline constexpr AtomId id = AtomId::Null;
   size_t size;
@@ -47,24 +125,118 @@ struct NullAtom {
   Result<> write([[maybe_unused]] std::ostream &out) const { return {}; }
 };
 
+/**
+ * Write an atom header, the payload produced by `body` and patch the atom
+ * size (and flags) in afterwards.
+ *
+ * This is useful for writing atoms whose payload is streamed rather than
+ * held in memory. With the Checksummed flag, the payload is checksummed as
+ * it's written and the checksum is appended to it; `body` can then still ask
+ * for its position, but can't seek back to patch what it wrote (and neither
+ * can atoms written inside it). Returns the payload size.
+ */
+template <typename F>
+  requires std::invocable<F &, std::ostream &>
+Result<size_t> writeAtom(std::ostream &out, AtomId id, F &&body,
+                         AtomFlags flags = {}) {
+  util::binWrite(out, id);
+
+  auto before = out.tellp();
+  if (before == -1) {
+    return std::unexpected("failed to query before position");
+  }
+
+  util::binWrite(out, 0ull);
+
+  auto start = out.tellp();
+  if (start == -1) {
+    return std::unexpected("failed to query start position");
+  }
+
+  if (flags.has(AtomFlags::Checksummed)) {
+    ChecksumWriter writer(*out.rdbuf());
+    std::ostream checked(&writer);
+
+    TRY(body(checked));
+
+    const uint32_t checksum = writer.checksum();
+    if (!checked || writer.failed()) {
+      return std::unexpected("failed to write atom payload");
+    }
+
+    util::binWrite(out, checksum);
+  } else {
+    TRY(body(out));
+  }
+
+  auto end = out.tellp();
+  if (end == -1) {
+    return std::unexpected("failed to query end position");
+  }
+
+  size_t size = end - start;
+  if (size >> 56 != 0) {
+    return std::unexpected("atom payload too large");
+  }
+
+  if (!out.seekp(before, std::ios::beg)) {
+    return std::unexpected("failed to seek back to the atom size");
+  }
+
+  util::binWrite<uint64_t>(out,
+                           size | static_cast<uint64_t>(flags.pack()) << 56);
+  out.seekp(end, std::ios::beg);
+
+  return size;
+}
+
 template <IsAtom... Ts> struct AtomSerializer {
   using Self = AtomSerializer<Ts...>;
   using Variant = std::variant<Ts...>;
   using AtomIdT = std::underlying_type_t<AtomId>;
-  using Read = Result<Variant> (*)(std::istream &, size_t);
-
+  using Read = Result<Variant> (*)(std::istream &, size_t, AtomFlags,
+                                   MemoryBudget &);
+
+  struct LookupEntry {
+    AtomIdT m_id;
+    Read m_read;
+  };
+
+  /**
+   * The readers of all atoms, sorted by id. Ids can be anything, so custom
+   * atoms can pick ids far away from the builtin ones.
+   */
   static consteval auto constructLookup() {
-    // AtomIds should be continuous and in ascending order; this is perfectly
-    // legal to do
-    std::array<Read, sizeof...(Ts)> lookup{};
+    std::array<LookupEntry, sizeof...(Ts)> lookup{
+        LookupEntry{static_cast<AtomIdT>(Ts::id), &wrap<Ts>}...};
 
-    ((lookup[static_cast<AtomIdT>(Ts::id)] = &wrap<Ts>), ...);
+    std::ranges::sort(lookup, {}, &LookupEntry::m_id);
     return lookup;
   }
 
   template <IsAtom T>
-  static Result<Variant> wrap(std::istream &in, size_t size) {
-    auto r = T::read(in, size);
+  static Result<Variant> wrap(std::istream &in, size_t size, AtomFlags flags,
+                              [[maybe_unused]] MemoryBudget &budget) {
+    // Atoms with flags the reader doesn't support are skipped, just like
+    // atoms with unknown ids
+    if constexpr (HasAtomFlags<T>) {
+      if (!T::supports(flags)) {
+        return NullAtom::read(in, size);
+      }
+    } else if (flags != AtomFlags{}) {
+      return NullAtom::read(in, size);
+    }
+
+    auto r = [&] {
+      if constexpr (HasBudgetedRead<T>) {
+        return T::read(in, size, flags, budget);
+      } else if constexpr (HasAtomFlags<T>) {
+        return T::read(in, size, flags);
+      } else {
+        return T::read(in, size);
+      }
+    }();
+
     if (r.has_value()) {
       return Variant{std::move(r.value())};
     }
@@ -74,21 +246,84 @@ template <IsAtom... Ts> struct AtomSerializer {
 
   static constexpr auto lookup = constructLookup();
 
-  static Result<Variant> read(std::istream &in, AtomId id, size_t size,
-                              uint8_t) {
-    AtomIdT idx = static_cast<AtomIdT>(id);
+  static_assert(std::ranges::adjacent_find(lookup, {}, &LookupEntry::m_id) ==
+                    lookup.end(),
+                "atoms in a registry need unique ids");
+
+  // Ids that are exactly 0, 1, 2... (like the builtin ones) index the lookup
+  // directly
+  static constexpr bool DENSE_IDS =
+      lookup.empty() || lookup.back().m_id == lookup.size() - 1;
+
+  /**
+   * The reader of the atom with given id, if there's one.
+   */
+  static constexpr Read findReader(AtomIdT id) {
+    if constexpr (DENSE_IDS) {
+      return id < lookup.size() ? lookup[id].m_read : nullptr;
+    } else {
+      const auto it = std::ranges::lower_bound(lookup, id, {},
+                                               &LookupEntry::m_id);
+      return it != lookup.end() && it->m_id == id ? it->m_read : nullptr;
+    }
+  }
 
+  static Result<Variant> read(std::istream &in, AtomId id, size_t size,
+                              uint8_t flags, MemoryBudget &budget) {
     // default to NullAtom if parser doesn't recognize atom type
     // this is incredibly useful for defining custom atoms
-    if (idx >= lookup.size())
+    const Read reader = findReader(static_cast<AtomIdT>(id));
+    if (!reader)
       return NullAtom::read(in, size);
-    if (auto reader = lookup[idx])
-      return reader(in, size);
 
-    return std::unexpected("invalid atom passed to reader");
+    AtomFlags atomFlags = AtomFlags::unpack(flags);
+    if (!atomFlags.has(AtomFlags::Checksummed))
+      return reader(in, size, atomFlags, budget);
+
+    return readChecksummed(in, reader, size, atomFlags, budget);
   }
 
-  static Result<Variant> read(std::istream &in) {
+  static Result<Variant> read(std::istream &in, AtomId id, size_t size,
+                              uint8_t flags) {
+    MemoryBudget budget;
+    return read(in, id, size, flags, budget);
+  }
+
+  /**
+   * Read a checksummed atom, verifying the checksum while the payload is
+   * read rather than in a separate pass.
+   */
+  static Result<Variant> readChecksummed(std::istream &in, Read reader,
+                                         size_t size, AtomFlags flags,
+                                         MemoryBudget &budget) {
+    if (size < sizeof(uint32_t)) {
+      return std::unexpected("checksummed atom is too small");
+    }
+
+    flags.m_features &= ~AtomFlags::Checksummed;
+    size -= sizeof(uint32_t);
+
+    ChecksumReader checksumReader(*in.rdbuf(), size);
+    std::istream checked(&checksumReader);
+
+    auto result = reader(checked, size, flags, budget);
+
+    // The atom may not have read (or may have skipped) some of its payload;
+    // the checksum covers all of it
+    const auto actual = checksumReader.finish();
+    const uint32_t expected = util::binRead<uint32_t>(in);
+    if (!actual || !in) {
+      return std::unexpected("unexpected end of stream while reading atom");
+    }
+
+    if (*actual != expected) {
+      return std::unexpected("atom checksum mismatch");
+    }
+
+    return result;
+  }
+
+  static Result<Variant> read(std::istream &in, MemoryBudget &budget) {
     AtomIdT id = util::binRead<AtomIdT>(in);
     size_t size = util::binRead<uint64_t>(in);
 
@@ -112,38 +347,31 @@ template <IsAtom... Ts> struct AtomSerializer {
       return std::unexpected("atom size exceeds remaining stream size");
     }
 
-    return Self::read(in, static_cast<AtomId>(id), size, flags);
+    return Self::read(in, static_cast<AtomId>(id), size, flags, budget);
   }
 
-  static Result<> write(std::ostream &out, Variant &a) {
+  static Result<Variant> read(std::istream &in) {
+    MemoryBudget budget;
+    return read(in, budget);
+  }
+
+  static Result<> write(std::ostream &out, Variant &a, bool checksum = false) {
     return std::visit(
         [&](auto &atom) -> Result<> {
-          util::binWrite(out, atom.id);
-
-          auto before = out.tellp();
-          if (before == -1) {
-            return std::unexpected("failed to query before position");
-          }
-
-          util::binWrite(out, 0ull);
+          using T = std::decay_t<decltype(atom)>;
 
-          auto start = out.tellp();
-          if (start == -1) {
-            return std::unexpected("failed to query start position");
+          AtomFlags flags;
+          if constexpr (HasAtomFlags<T>) {
+            flags = atom.flags();
           }
-          atom.write(out);
 
-          auto end = out.tellp();
-          if (end == -1) {
-            return std::unexpected("failed to query end position");
+          if (checksum) {
+            flags.m_features |= AtomFlags::Checksummed;
           }
 
-          atom.size = end - start;
-
-          out.seekp(before, std::ios::beg);
-
-          util::binWrite<uint64_t>(out, atom.size);
-          out.seekp(end, std::ios::beg);
+          atom.size = TRY(writeAtom(
+              out, atom.id, [&](std::ostream &o) { return atom.write(o); },
+              flags));
 
           return {};
         },
@@ -162,11 +390,58 @@ public:
   std::vector<Variant> m_atoms;
 
   void add(const Variant &v) { m_atoms.push_back(v); }
-  void add(Variant &&v) { m_atoms.push_back(v); }
+  void add(Variant &&v) { m_atoms.push_back(std::move(v)); }
+
+  /**
+   * Construct an atom of type `T` in place at the end of the registry.
+   */
+  template <typename T, typename... Args>
+    requires(std::same_as<T, Ts> || ...)
+  T &emplace(Args &&...args) {
+    return std::get<T>(m_atoms.emplace_back(std::in_place_type<T>,
+                                            std::forward<Args>(args)...));
+  }
 
   size_t count() const { return m_atoms.size(); }
 
-  Result<> readAll(std::istream &in) {
+  /**
+   * How many atoms of type `T` there are.
+   */
+  template <typename T>
+    requires(std::same_as<T, Ts> || ...)
+  size_t count() const {
+    return std::ranges::count_if(m_atoms, [](const Variant &v) {
+      return std::holds_alternative<T>(v);
+    });
+  }
+
+  /**
+   * The `index`th atom of type `T`, or a null pointer if there aren't that
+   * many.
+   */
+  template <typename T>
+    requires(std::same_as<T, Ts> || ...)
+  T *get(size_t index = 0) {
+    for (auto &atom : m_atoms) {
+      if (auto *typed = std::get_if<T>(&atom); typed && index-- == 0) {
+        return typed;
+      }
+    }
+
+    return nullptr;
+  }
+
+  template <typename T>
+    requires(std::same_as<T, Ts> || ...)
+  const T *get(size_t index = 0) const {
+    return const_cast<AtomRegistry *>(this)->template get<T>(index);
+  }
+
+  /**
+   * Read atoms up to the container footer.
+   * The memory budget in `options` is shared by all of them.
+   */
+  Result<> readAll(std::istream &in, const ReadOptions &options = {}) {
     auto pos = in.tellg();
     if (pos == -1) {
       return std::unexpected("failed to query position");
@@ -181,18 +456,23 @@ public:
     in.seekg(pos, std::ios::beg);
     end -= 1; // subtract one for footer length
 
+    MemoryBudget budget(options.m_memoryBudget);
     while (in.tellg() < end) {
-      auto result = TRY(Serializer::read(in));
-      this->add(result);
+      this->add(TRY(Serializer::read(in, budget)));
     }
 
     return {};
   }
 
-  void writeAll(std::ostream &out) {
+  /**
+   * Write all atoms, optionally with a checksum each.
+   */
+  Result<> writeAll(std::ostream &out, bool checksums = false) {
     for (auto &atom : m_atoms) {
-      Serializer::write(out, atom);
+      TRY(Serializer::write(out, atom, checksums));
     }
+
+    return {};
   }
 };
 
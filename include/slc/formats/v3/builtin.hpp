@@ -2,143 +2,474 @@
 #define _SLC_V3_BUILTIN_HPP
 
 #include "slc/formats/v3/atom.hpp"
+#include "slc/formats/v3/encoder.hpp"
+#include "slc/formats/v3/instrumentation.hpp"
+#include "slc/formats/v3/marker.hpp"
+#include "slc/formats/v3/rans.hpp"
+#include "slc/formats/v3/report.hpp"
 #include "slc/formats/v3/section.hpp"
 #include "slc/util.hpp"
 
+#include <algorithm>
+#include <optional>
+#include <span>
+#include <spanstream>
+#include <sstream>
+
 SLC_NS_BEGIN
 
 namespace v3 {
 
-struct ActionAtom {
+/**
+ * Read the sections of a compressed action atom and entropy decode them.
+ *
+ * The stream has to be positioned right after the action count; `size` is
+ * how many bytes of the payload are left from there. The decoded sections
+ * are taken out of `budget`.
+ */
+inline Result<std::vector<char>> readCompressedSections(std::istream &in,
+                                                        size_t size,
+                                                        uint64_t count,
+                                                        MemoryBudget &budget) {
+  if (size < sizeof(uint64_t)) {
+    return std::unexpected("truncated compressed ActionAtom");
+  }
+
+  // No section takes up more than a header, an 8-byte delta and an 8-byte
+  // seed or TPS per action, so anything larger is malformed
+  constexpr uint64_t MAX_ACTION_BYTES = sizeof(uint16_t) + 2 * sizeof(uint64_t);
+
+  const uint64_t rawSize = util::binRead<uint64_t>(in);
+  if (rawSize / MAX_ACTION_BYTES > count) {
+    return std::unexpected("compressed ActionAtom is larger than its actions");
+  }
+
+  if (!budget.take<char>(rawSize)) {
+    return std::unexpected("ActionAtom exceeds the memory budget");
+  }
+
+  std::vector<uint8_t> coded(size - sizeof(uint64_t));
+  in.read(reinterpret_cast<char *>(coded.data()), coded.size());
+  if (!in) {
+    return std::unexpected(
+        "unexpected end of stream while reading ActionAtom");
+  }
+
+  std::vector<char> sections(rawSize);
+  TRY(rans::decode(coded,
+                   std::span(reinterpret_cast<uint8_t *>(sections.data()),
+                             sections.size())));
+
+  return sections;
+}
+
+inline Result<std::vector<char>>
+readCompressedSections(std::istream &in, size_t size, uint64_t count) {
+  MemoryBudget budget;
+  return readCompressedSections(in, size, count, budget);
+}
+
+/**
+ * The atom holding the actions of a replay.
+ *
+ * Encoding and decoding are reported to the `Instr` instrumentation policy;
+ * see [`IsInstrumentation`].
+ */
+template <IsInstrumentation Instr = NoInstrumentation> struct BasicActionAtom {
   static inline constexpr AtomId id = AtomId::Action;
   size_t size;
 
   std::vector<Action> m_actions;
 
-private:
-  static inline bool swiftCompatible(std::vector<Action> &actions, size_t i) {
-    assert(i < actions.size());
+  /**
+   * Set this to an empty report to have the next [`write`] fill it in.
+   * See [`EncodingReport`].
+   */
+  std::optional<EncodingReport> m_report;
+
+  /**
+   * Entropy code the sections when writing, see [`rans`].
+   * Compressed atoms are written with the Compressed atom flag.
+   */
+  bool m_compressed = false;
+
+  /**
+   * Store the inputs of player 2 in a stream of their own when writing, so
+   * the inputs of each player make longer runs (and more repeats) than they
+   * do interleaved. This helps two-player replays, and does nothing for
+   * others. Split atoms are written with the Split atom flag.
+   *
+   * Player 1 inputs and all other actions stay in the first stream. When
+   * read, the streams are merged by frame, with the first stream's actions
+   * first on the same frame, so player 2 inputs only go into the second
+   * stream when nothing after them on their frame stays in the first one.
+   * Actions come back in the order they were written in.
+   */
+  bool m_split = false;
+
+  /**
+   * Section types beyond the original ones to encode with, see
+   * [`EncodingOptions`]. The atom is written with the version they need.
+   */
+  EncodingOptions m_encoding;
+
+public:
+  /**
+   * Read an action atom from a stream of given size.
+   * It's recommended to use this function from an atom registry.
+   * See [`AtomRegistry::readAll`].
+   */
+  static Result<BasicActionAtom> read(std::istream &in, size_t size) {
+    MemoryBudget budget;
+    return read(in, size, {}, budget);
+  }
 
-    return actions[i].delta() == 0 && !actions[i].m_holding &&
-           actions[i - 1].m_holding != actions[i].m_holding &&
-           actions[i - 1].m_player2 == actions[i].m_player2 &&
-           actions[i - 1].m_type == actions[i].m_type &&
-           actions[i].m_type == Action::ActionType::Jump;
+  /**
+   * Read an action atom with given atom flags.
+   */
+  static Result<BasicActionAtom> read(std::istream &in, size_t size,
+                                      AtomFlags flags) {
+    MemoryBudget budget;
+    return read(in, size, flags, budget);
   }
 
-  static inline bool canJoin(std::vector<Action> &actions, size_t count,
-                             size_t i) {
-    static constexpr size_t MAX_SECTION_ACTIONS = 1 << 16;
+  /**
+   * Read an action atom with given atom flags, taking its actions out of
+   * `budget`. Fails before allocating if they don't fit.
+   */
+  static Result<BasicActionAtom> read(std::istream &in, size_t size,
+                                      AtomFlags flags, MemoryBudget &budget) {
+    if (!supports(flags)) {
+      return std::unexpected("unsupported action atom flags");
+    }
+
+    ScopedPhase<Instr> timer(Phase::ReadAtom);
+
+    BasicActionAtom a;
+    a.size = size;
+    a.m_compressed = flags.has(AtomFlags::Compressed);
+    a.m_split = flags.has(AtomFlags::Split);
+    a.m_encoding = EncodingOptions::forVersion(flags.m_version);
+
+    if (size < sizeof(uint64_t)) {
+      return std::unexpected("truncated ActionAtom");
+    }
+
+    const uint64_t count = util::binRead<uint64_t>(in);
+    if (!budget.take<Action>(count)) {
+      return std::unexpected("ActionAtom exceeds the memory budget");
+    }
+
+    if (!a.m_compressed) {
+      TRY(readSections(in, size - sizeof(uint64_t), count, a.m_split, budget,
+                       a.m_actions));
+      return a;
+    }
+
+    const auto sections =
+        TRY(readCompressedSections(in, size - sizeof(uint64_t), count, budget));
+
+    std::ispanstream stream(sections);
+    TRY(readSections(stream, sections.size(), count, a.m_split, budget,
+                     a.m_actions));
 
-    return i < (actions.size() - 1) && count < MAX_SECTION_ACTIONS &&
-           actions[i + 1].isPlayer() &&
-           actions[i + 1].getMinimumSize() == actions[i].getMinimumSize();
+    return a;
   }
 
-  // "literally slc2"
-  static Result<> prepareSections(std::vector<Action> &actions,
-                                  std::vector<Section> &sections) {
-    size_t i = 0;
-    while (i < actions.size()) {
-      if (!actions[i].isPlayer()) {
-        auto section = TRY(Section::special(actions[i]));
+  /**
+   * Whether action atoms with given flags can be read.
+   */
+  static constexpr bool supports(AtomFlags flags) {
+    return flags.m_version <= EncodingOptions::LATEST_VERSION &&
+           (flags.m_features & ~(AtomFlags::Compressed | AtomFlags::Split)) ==
+               0;
+  }
 
-        sections.push_back(std::move(section));
+  /**
+   * The atom flags this atom is written with.
+   */
+  AtomFlags flags() const {
+    AtomFlags flags{.m_version = m_encoding.version()};
+    if (m_compressed) {
+      flags.m_features |= AtomFlags::Compressed;
+    }
 
-        i++;
+    if (m_split) {
+      flags.m_features |= AtomFlags::Split;
+    }
 
-        continue;
-      }
+    return flags;
+  }
+
+  /**
+   * Write an action atom to a stream.
+   * It's recommended to use this function from an atom registry.
+   * See [`AtomRegistry::writeAll`].
+   */
+  Result<> write(std::ostream &out) {
+    util::binWrite<uint64_t>(out, m_actions.size());
+
+    EncodingReport *report = nullptr;
+    if (m_report) {
+      // The atom header and the action count
+      *m_report = {};
+      m_report->m_headerBytes =
+          sizeof(AtomId) + sizeof(uint64_t) + sizeof(uint64_t);
+      report = &*m_report;
+    }
 
-      uint32_t count = 1;
-      uint32_t pureCount = 1;
-      uint32_t swifts = 0;
-      uint32_t pureSwifts = 0;
-      size_t start = i;
+    if (!m_compressed) {
+      return writeSections(out, report);
+    }
 
-      uint8_t minSize = actions[i].getMinimumSize();
+    std::ostringstream sections;
+    TRY(writeSections(sections, report));
 
-      while (canJoin(actions, pureCount, i)) {
-        i++;
-        count++;
+    const std::string raw = std::move(sections).str();
+    const auto coded = rans::encode(std::span(
+        reinterpret_cast<const uint8_t *>(raw.data()), raw.size()));
 
-        if (swiftCompatible(actions, i)) {
-          actions[i - 1].m_swift = true;
-          actions[i].m_swift = true;
-          swifts++;
-        } else {
-          pureCount++;
-        }
+    util::binWrite<uint64_t>(out, raw.size());
+    out.write(reinterpret_cast<const char *>(coded.data()), coded.size());
 
-        if ((uint32_t)util::largestPowerOfTwo(pureCount) == pureCount) {
-          pureSwifts = swifts;
-        }
+    if (report) {
+      report->m_headerBytes += sizeof(uint64_t);
+      report->m_compressedBytes = coded.size();
+    }
+
+    return {};
+  }
+
+private:
+  // Every action takes up at least half a byte of sections (a one byte swift
+  // input holds two), except for those expanded from repeat and progression
+  // sections, and copied by back-references
+  static constexpr uint64_t MAX_ACTIONS_PER_BYTE = 2;
+
+  /**
+   * Read `count` actions from `size` bytes of sections.
+   *
+   * The count comes straight from the file, so only as many actions as the
+   * sections can hold are reserved up front; anything past that (which only
+   * repeat sections produce) grows the vector as usual.
+   */
+  static Result<> readStream(std::istream &in, size_t size, uint64_t count,
+                             std::vector<Action> &actions) {
+    actions.reserve(std::min<uint64_t>(count, size * MAX_ACTIONS_PER_BYTE));
+
+    while (actions.size() < count) {
+      if (in.eof() || in.fail()) {
+        return std::unexpected(
+            "unexpected end of stream while reading ActionAtom");
       }
 
-      count--;
+      TRY(Section::read(in, actions, count));
+    }
 
-      count = util::largestPowerOfTwo(pureCount);
-      i = start + count + pureSwifts;
+    return {};
+  }
 
-      Section s = Section::player(actions, start, i);
-      s.m_deltaSize = minSize;
+  /**
+   * Read `count` actions from `size` bytes of sections, which are split by
+   * player if `split` is set.
+   *
+   * Split sections start with the action count of the second stream and the
+   * size of the first one, followed by both streams.
+   */
+  static Result<> readSections(std::istream &in, size_t size, uint64_t count,
+                               bool split, MemoryBudget &budget,
+                               std::vector<Action> &actions) {
+    if (!split) {
+      return readStream(in, size, count, actions);
+    }
 
-      auto realSections = s.runLengthEncode();
+    if (size < 2 * sizeof(uint64_t)) {
+      return std::unexpected("truncated split ActionAtom");
+    }
+
+    const uint64_t secondCount = util::binRead<uint64_t>(in);
+    const uint64_t firstSize = util::binRead<uint64_t>(in);
+    size -= 2 * sizeof(uint64_t);
 
-      sections.insert(sections.end(), realSections.begin(), realSections.end());
+    if (secondCount > count || firstSize > size) {
+      return std::unexpected("split ActionAtom streams exceed the atom");
     }
 
+    if (!budget.take<Action>(secondCount)) {
+      return std::unexpected("ActionAtom exceeds the memory budget");
+    }
+
+    TRY(readStream(in, firstSize, count - secondCount, actions));
+
+    std::vector<Action> second;
+    TRY(readStream(in, size - firstSize, secondCount, second));
+
+    mergeStreams(actions, second);
+
     return {};
   }
 
-public:
   /**
-   * Read an action atom from a stream of given size.
-   * It's recommended to use this function from an atom registry.
-   * See [`AtomRegistry::readAll`].
+   * Merge the second stream of a split atom into the first, in place.
+   * Deltas are relative to the previous action of the same stream until
+   * they're recalculated here.
    */
-  static Result<ActionAtom> read(std::istream &in, size_t size) {
-    ActionAtom a;
-    a.size = size;
+  static void mergeStreams(std::vector<Action> &actions,
+                           const std::vector<Action> &second) {
+    size_t i = actions.size();
+    size_t j = second.size();
+    actions.resize(i + j);
+
+    // Merge from the back; on ties the first stream goes first, so it's
+    // placed last here
+    size_t k = actions.size();
+    while (j > 0) {
+      if (i > 0 && actions[i - 1].m_frame > second[j - 1].m_frame) {
+        actions[--k] = actions[--i];
+      } else {
+        actions[--k] = second[--j];
+      }
+    }
+
+    for (size_t n = 0; n < actions.size(); n++) {
+      actions[n].recalculateDelta(n == 0 ? 0 : actions[n - 1].m_frame);
+    }
+  }
 
-    size_t count = util::binRead<uint64_t>(in);
-    a.m_actions.reserve(count);
+  /**
+   * Write the sections of this atom, split by player if [`m_split`] is set.
+   */
+  Result<> writeSections(std::ostream &out, EncodingReport *report) {
+    if (!m_split) {
+      return BasicActionEncoder<Instr>::write(out, m_actions, report,
+                                              m_encoding);
+    }
 
-    while (a.m_actions.size() < count) {
-      if (in.eof()) {
-        return std::unexpected(
-            "unexpected end of stream while reading ActionAtom");
+    const auto isPlayer2 = [](const Action &action) {
+      return action.isPlayer() && action.m_player2;
+    };
+
+    // Every stream has a delta chain of its own
+    std::vector<Action> first;
+    std::vector<Action> second;
+    uint64_t firstFrame = 0;
+    uint64_t secondFrame = 0;
+    for (size_t i = 0; i < m_actions.size();) {
+      // Only the player 2 inputs at the end of a frame can be read back
+      // after the rest of it
+      size_t end = i;
+      size_t trailing = i;
+      while (end < m_actions.size() &&
+             m_actions[end].m_frame == m_actions[i].m_frame) {
+        if (!isPlayer2(m_actions[end])) {
+          trailing = end + 1;
+        }
+
+        end++;
       }
 
-      Section::read(in, a.m_actions);
+      for (; i < end; i++) {
+        Action action = m_actions[i];
+        if (i >= trailing) {
+          action.recalculateDelta(secondFrame);
+          secondFrame = action.m_frame;
+          second.push_back(action);
+        } else {
+          action.recalculateDelta(firstFrame);
+          firstFrame = action.m_frame;
+          first.push_back(action);
+        }
+      }
     }
 
-    return a;
+    std::ostringstream firstSections;
+    TRY(BasicActionEncoder<Instr>::write(firstSections, first, report,
+                                         m_encoding));
+    const std::string firstRaw = std::move(firstSections).str();
+
+    util::binWrite<uint64_t>(out, second.size());
+    util::binWrite<uint64_t>(out, firstRaw.size());
+    out.write(firstRaw.data(), firstRaw.size());
+
+    if (report) {
+      report->m_headerBytes += 2 * sizeof(uint64_t);
+    }
+
+    return BasicActionEncoder<Instr>::write(out, second, report, m_encoding);
   }
 
   /**
-   * Write an action atom to a stream.
-   * It's recommended to use this function from an atom registry.
-   * See [`AtomRegistry::writeAll`].
+   * Recalculate the deltas of the actions in `[first, last)`, as far as
+   * there are any.
    */
-  Result<> write(std::ostream &out) {
-    util::binWrite<uint64_t>(out, m_actions.size());
+  void recalculateDeltas(size_t first, size_t last) {
+    last = std::min(last, m_actions.size());
+    for (size_t i = first; i < last; i++) {
+      m_actions[i].recalculateDelta(i == 0 ? 0 : m_actions[i - 1].m_frame);
+    }
+  }
 
-    std::vector<Section> sections;
+  /**
+   * Check that a batch of actions can go after given frame: frames don't go
+   * backwards, types are valid and TPS is positive.
+   */
+  static Result<> checkBatch(std::span<const Action> actions,
+                             uint64_t previousFrame) {
+    if (actions.empty()) {
+      return {};
+    }
 
-    TRY(ActionAtom::prepareSections(m_actions, sections));
+    // Checked without branching so this vectorizes; the bad action is only
+    // looked for if there is one
+    bool valid = actions.front().m_frame >= previousFrame;
+    for (size_t i = 0; i < actions.size(); i++) {
+      const auto &action = actions[i];
+      const auto type = static_cast<uint8_t>(action.m_type);
+
+      valid &= i == 0 || action.m_frame >= actions[i - 1].m_frame;
+      valid &= static_cast<uint8_t>(type - 1) <
+               static_cast<uint8_t>(Action::ActionType::Bugpoint);
+      valid &= action.m_type != Action::ActionType::TPS || action.m_tps > 0.0;
+    }
 
-    for (auto &section : sections) {
-      section.write(out);
+    if (!valid) {
+      return std::unexpected(invalidAction(actions, previousFrame));
     }
 
     return {};
   }
 
+  /**
+   * Why the first bad action of a batch can't be added.
+   */
+  static const char *invalidAction(std::span<const Action> actions,
+                                   uint64_t previousFrame) {
+    using At = Action::ActionType;
+    for (const auto &action : actions) {
+      if (action.m_frame < previousFrame) {
+        return "action frame is before the previous action; "
+               "use a ReorderBuffer for unordered actions";
+      }
+
+      if (!util::inRange<At, At::Jump, At::Bugpoint>(action.m_type)) {
+        return "invalid action type provided to ActionAtom";
+      }
+
+      if (action.m_type == At::TPS && !(action.m_tps > 0.0)) {
+        return "invalid tps provided to ActionAtom; must be positive";
+      }
+
+      previousFrame = action.m_frame;
+    }
+
+    return "invalid action provided to ActionAtom";
+  }
+
+public:
   /**
    * Add a player action to a replay.
    * This only supports Jump, Left and Right actions.
-   * Frame delta is based on previous action.
+   * Frame delta is based on previous action, and frames can't go backwards.
    */
   Result<> addAction(uint64_t frame, Action::ActionType actionType,
                      bool holding, bool p2) {
@@ -153,6 +484,11 @@ public:
       previousFrame = m_actions.back().m_frame;
     }
 
+    if (frame < previousFrame) {
+      return std::unexpected("action frame is before the previous action; "
+                             "use a ReorderBuffer for unordered actions");
+    }
+
     uint64_t delta = frame - previousFrame;
 
     m_actions.push_back(Action(previousFrame, delta, actionType, holding, p2));
@@ -163,7 +499,7 @@ public:
   /**
    * Add a death action to a replay.
    * This only supports Restart, RestartFull and Death actions.
-   * Frame delta is based on previous action.
+   * Frame delta is based on previous action, and frames can't go backwards.
    */
   Result<> addAction(uint64_t frame, Action::ActionType actionType,
                      uint64_t seed) {
@@ -178,6 +514,11 @@ public:
       previousFrame = m_actions.back().m_frame;
     }
 
+    if (frame < previousFrame) {
+      return std::unexpected("action frame is before the previous action; "
+                             "use a ReorderBuffer for unordered actions");
+    }
+
     uint64_t delta = frame - previousFrame;
 
     m_actions.push_back(Action(previousFrame, delta, actionType, seed));
@@ -187,7 +528,7 @@ public:
 
   /**
    * Add a TPS action to a replay.
-   * Frame delta is based on previous action.
+   * Frame delta is based on previous action, and frames can't go backwards.
    */
   Result<> addAction(uint64_t frame, double tps) {
     if (tps <= 0.0) {
@@ -200,6 +541,11 @@ public:
       previousFrame = m_actions.back().m_frame;
     }
 
+    if (frame < previousFrame) {
+      return std::unexpected("action frame is before the previous action; "
+                             "use a ReorderBuffer for unordered actions");
+    }
+
     uint64_t delta = frame - previousFrame;
 
     m_actions.push_back(Action(previousFrame, delta, tps));
@@ -207,6 +553,127 @@ public:
     return {};
   }
 
+  /**
+   * Add a batch of actions at once, on the frames they're already on.
+   * Deltas are recalculated, so actions can be made with a current frame of 0
+   * and their frame as the delta (like [`BasicActionEncoder::push`] takes).
+   * Frames can't go backwards, and nothing is added if any action is invalid.
+   */
+  Result<> addActions(std::span<const Action> actions) {
+    if (actions.empty()) {
+      return {};
+    }
+
+    TRY(checkBatch(actions, m_actions.empty() ? 0 : m_actions.back().m_frame));
+
+    const size_t start = m_actions.size();
+    m_actions.insert(m_actions.end(), actions.begin(), actions.end());
+    recalculateDeltas(start, m_actions.size());
+
+    return {};
+  }
+
+  /**
+   * Index of the first action on or after given frame.
+   */
+  size_t lowerBound(uint64_t frame) const {
+    return std::ranges::lower_bound(m_actions, frame, {}, &Action::m_frame) -
+           m_actions.begin();
+  }
+
+  /**
+   * Index of the first action after given frame.
+   */
+  size_t upperBound(uint64_t frame) const {
+    return std::ranges::upper_bound(m_actions, frame, {}, &Action::m_frame) -
+           m_actions.begin();
+  }
+
+  /**
+   * Insert an action on the frame it's already on, after any other actions
+   * on that frame. Only the deltas of it and the action after it change.
+   */
+  Result<> insertAction(const Action &action) {
+    TRY(checkBatch(std::span(&action, 1), 0));
+
+    const size_t index = upperBound(action.m_frame);
+    m_actions.insert(m_actions.begin() + index, action);
+    recalculateDeltas(index, index + 2);
+
+    return {};
+  }
+
+  /**
+   * Remove the action at given index.
+   */
+  void removeAction(size_t index) {
+    assert(index < m_actions.size());
+
+    m_actions.erase(m_actions.begin() + index);
+    recalculateDeltas(index, index + 1);
+  }
+
+  /**
+   * Remove the actions on frames `[from, to)`.
+   */
+  void removeActions(uint64_t from, uint64_t to) {
+    const size_t first = lowerBound(from);
+    const size_t last = std::max(first, lowerBound(to));
+
+    m_actions.erase(m_actions.begin() + first, m_actions.begin() + last);
+    recalculateDeltas(first, first + 1);
+  }
+
+  /**
+   * Replace the actions on frames `[from, to)` with given actions, which have
+   * to be on frames in that range too (on the frames they're already on, like
+   * [`addActions`]). Nothing changes if any of them is invalid.
+   */
+  Result<> spliceActions(uint64_t from, uint64_t to,
+                         std::span<const Action> actions) {
+    if (to < from) {
+      return std::unexpected("invalid frame range provided to spliceActions");
+    }
+
+    if (!actions.empty() &&
+        (actions.front().m_frame < from || actions.back().m_frame >= to)) {
+      return std::unexpected("action frame is outside of the spliced range");
+    }
+
+    TRY(checkBatch(actions, from));
+
+    const size_t first = lowerBound(from);
+    const size_t last = lowerBound(to);
+
+    // Reuse the slots of the replaced actions, and only shift the tail once
+    const size_t common = std::min(last - first, actions.size());
+    std::copy_n(actions.begin(), common, m_actions.begin() + first);
+    if (actions.size() > common) {
+      m_actions.insert(m_actions.begin() + last, actions.begin() + common,
+                       actions.end());
+    } else {
+      m_actions.erase(m_actions.begin() + first + common,
+                      m_actions.begin() + last);
+    }
+
+    recalculateDeltas(first, first + actions.size() + 1);
+
+    return {};
+  }
+
+  /**
+   * Fill in where given markers are in this atom once it's written.
+   * See [`BasicActionEncoder::resolve`].
+   */
+  Result<> resolveMarkers(MarkerAtom &markers) const {
+    if (m_split) {
+      return std::unexpected("markers can't point into split action atoms");
+    }
+
+    return BasicActionEncoder<Instr>::resolve(m_actions, markers.m_markers,
+                                              m_encoding);
+  }
+
   /**
    * The length of the underlying Action array.
    */
@@ -222,10 +689,12 @@ public:
    * after or during the given frame.
    */
   void clipActions(uint64_t frame) {
-    std::erase_if(m_actions, [frame](auto &a) { return a.m_frame >= frame; });
+    m_actions.erase(m_actions.begin() + lowerBound(frame), m_actions.end());
   }
 };
 
+using ActionAtom = BasicActionAtom<>;
+
 } // namespace v3
 
 SLC_NS_END
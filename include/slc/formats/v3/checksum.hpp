@@ -0,0 +1,421 @@
+#ifndef _SLC_V3_CHECKSUM_HPP
+#define _SLC_V3_CHECKSUM_HPP
+
+#include "slc/util.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <streambuf>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+SLC_NS_BEGIN
+
+namespace v3 {
+
+/**
+ * CRC32C (Castagnoli), as used for atom and metadata checksums.
+ *
+ * Uses the SSE 4.2 `crc32` instruction when the CPU has it (checked once, at
+ * runtime) or the ARMv8 CRC extension when compiled for it, and a
+ * slice-by-8 table implementation otherwise.
+ */
+namespace crc32c {
+
+constexpr uint32_t POLYNOMIAL = 0x82F63B78;
+
+constexpr std::array<std::array<uint32_t, 256>, 8> makeTables() {
+  std::array<std::array<uint32_t, 256>, 8> tables{};
+
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (POLYNOMIAL & (0u - (crc & 1)));
+    }
+
+    tables[0][i] = crc;
+  }
+
+  for (size_t k = 1; k < 8; k++) {
+    for (size_t i = 0; i < 256; i++) {
+      const uint32_t previous = tables[k - 1][i];
+      tables[k][i] = (previous >> 8) ^ tables[0][previous & 0xFF];
+    }
+  }
+
+  return tables;
+}
+
+inline constexpr auto TABLES = makeTables();
+
+/**
+ * Update a raw (not inverted) CRC with given data, without any hardware
+ * support.
+ */
+inline uint32_t updatePortable(uint32_t crc, const uint8_t *data,
+                               size_t size) {
+  while (size >= 8) {
+    uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    word ^= crc;
+
+    crc = TABLES[7][word & 0xFF] ^ TABLES[6][(word >> 8) & 0xFF] ^
+          TABLES[5][(word >> 16) & 0xFF] ^ TABLES[4][(word >> 24) & 0xFF] ^
+          TABLES[3][(word >> 32) & 0xFF] ^ TABLES[2][(word >> 40) & 0xFF] ^
+          TABLES[1][(word >> 48) & 0xFF] ^ TABLES[0][word >> 56];
+
+    data += 8;
+    size -= 8;
+  }
+
+  while (size-- > 0) {
+    crc = TABLES[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+  }
+
+  return crc;
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("sse4.2"))) inline uint32_t
+updateHardware(uint32_t crc, const uint8_t *data, size_t size) {
+  uint64_t crc64 = crc;
+  while (size >= 8) {
+    uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    crc64 = _mm_crc32_u64(crc64, word);
+
+    data += 8;
+    size -= 8;
+  }
+
+  crc = static_cast<uint32_t>(crc64);
+  while (size-- > 0) {
+    crc = _mm_crc32_u8(crc, *data++);
+  }
+
+  return crc;
+}
+
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+
+inline uint32_t updateHardware(uint32_t crc, const uint8_t *data,
+                               size_t size) {
+  while (size >= 8) {
+    uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    crc = __crc32cd(crc, word);
+
+    data += 8;
+    size -= 8;
+  }
+
+  while (size-- > 0) {
+    crc = __crc32cb(crc, *data++);
+  }
+
+  return crc;
+}
+
+#endif
+
+using UpdateFn = uint32_t (*)(uint32_t, const uint8_t *, size_t);
+
+inline UpdateFn selectUpdate() {
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse4.2")) {
+    return &updateHardware;
+  }
+
+  return &updatePortable;
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+  return &updateHardware;
+#else
+  return &updatePortable;
+#endif
+}
+
+/**
+ * Continue a CRC32C over more data. Start from 0.
+ */
+inline uint32_t update(uint32_t crc, std::span<const uint8_t> data) {
+  static const UpdateFn fn = selectUpdate();
+  return ~fn(~crc, data.data(), data.size());
+}
+
+inline uint32_t update(uint32_t crc, std::span<const char> data) {
+  return update(crc, std::span(reinterpret_cast<const uint8_t *>(data.data()),
+                               data.size()));
+}
+
+/**
+ * The CRC32C of given data.
+ */
+inline uint32_t compute(std::span<const uint8_t> data) {
+  return update(0, data);
+}
+
+} // namespace crc32c
+
+/**
+ * A stream buffer that passes everything written to it on to another stream
+ * buffer, computing its CRC32C along the way.
+ *
+ * Writes are buffered and checksummed a chunk at a time, so writing through
+ * it costs about as much as writing to the underlying stream.
+ *
+ * Positions are those of the underlying stream buffer (or offsets from where
+ * writing started, if it can't tell). Bytes that have been checksummed can't
+ * be written again, so only seeks to the current position succeed.
+ */
+class ChecksumWriter : public std::streambuf {
+private:
+  static constexpr size_t BUFFER_SIZE = 16 * 1024;
+
+  std::streambuf &m_dest;
+  std::array<char, BUFFER_SIZE> m_buffer;
+  std::streamoff m_base;
+  // Bytes passed on to the destination so far
+  std::streamoff m_written = 0;
+  uint32_t m_crc = 0;
+  bool m_failed = false;
+
+  void flushBuffer() {
+    const std::span<const char> pending(pbase(), pptr());
+    m_crc = crc32c::update(m_crc, pending);
+
+    const auto written = m_dest.sputn(pending.data(), pending.size());
+    m_failed |= written != static_cast<std::streamsize>(pending.size());
+    m_written += pending.size();
+
+    setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+  }
+
+protected:
+  int_type overflow(int_type c) override {
+    flushBuffer();
+
+    if (traits_type::eq_int_type(c, traits_type::eof())) {
+      return traits_type::not_eof(c);
+    }
+
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+    return m_failed ? traits_type::eof() : c;
+  }
+
+  int sync() override {
+    flushBuffer();
+    return m_failed ? -1 : 0;
+  }
+
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                   std::ios_base::openmode which) override {
+    if (!(which & std::ios_base::out)) {
+      return pos_type(off_type(-1));
+    }
+
+    // Written bytes always end at the current position
+    const off_type current = m_base + m_written + (pptr() - pbase());
+    const off_type target = dir == std::ios_base::beg ? off : current + off;
+
+    return target == current ? pos_type(current) : pos_type(off_type(-1));
+  }
+
+  pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+    return seekoff(off_type(pos), std::ios_base::beg, which);
+  }
+
+public:
+  explicit ChecksumWriter(std::streambuf &dest)
+      : m_dest(dest),
+        m_base(dest.pubseekoff(0, std::ios_base::cur, std::ios_base::out)) {
+    if (m_base == -1) {
+      m_base = 0;
+    }
+
+    setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+  }
+
+  /**
+   * The CRC32C of everything written so far. Flushes the buffer.
+   */
+  uint32_t checksum() {
+    flushBuffer();
+    return m_crc;
+  }
+
+  bool failed() const { return m_failed; }
+};
+
+/**
+ * A stream buffer that reads at most `size` bytes from another stream
+ * buffer, computing their CRC32C along the way.
+ *
+ * Positions are those of the source (or offsets from where reading started,
+ * if it can't tell), and the end is the end of the `size` bytes. Seeking
+ * forward skips bytes lazily (they're still checksummed once they're passed),
+ * seeking back only works within the bytes that are still buffered.
+ */
+class ChecksumReader : public std::streambuf {
+private:
+  static constexpr size_t BUFFER_SIZE = 16 * 1024;
+
+  std::streambuf &m_source;
+  std::array<char, BUFFER_SIZE> m_buffer;
+  std::streamoff m_base;
+  size_t m_size;
+  size_t m_remaining;
+  // Where reading continues after a forward seek past the buffer
+  std::optional<size_t> m_skipTo;
+  uint32_t m_crc = 0;
+
+  // Offset of the next byte of the source
+  size_t loaded() const { return m_size - m_remaining; }
+
+  size_t load(char *dest, size_t wanted) {
+    const auto got = wanted == 0 ? 0 : m_source.sgetn(dest, wanted);
+    if (got <= 0) {
+      return 0;
+    }
+
+    m_remaining -= got;
+    m_crc = crc32c::update(m_crc, std::span<const char>(dest, got));
+    return got;
+  }
+
+  // Pass (and checksum) the bytes a forward seek skipped
+  bool skip() {
+    if (!m_skipTo) {
+      return true;
+    }
+
+    while (loaded() < *m_skipTo) {
+      const size_t wanted = std::min(*m_skipTo - loaded(), m_buffer.size());
+      if (load(m_buffer.data(), wanted) == 0) {
+        return false;
+      }
+    }
+
+    m_skipTo.reset();
+    setg(m_buffer.data(), m_buffer.data(), m_buffer.data());
+    return true;
+  }
+
+protected:
+  int_type underflow() override {
+    if (gptr() < egptr()) {
+      return traits_type::to_int_type(*gptr());
+    }
+
+    if (!skip()) {
+      return traits_type::eof();
+    }
+
+    const size_t got =
+        load(m_buffer.data(), std::min(m_remaining, m_buffer.size()));
+    if (got == 0) {
+      return traits_type::eof();
+    }
+
+    setg(m_buffer.data(), m_buffer.data(), m_buffer.data() + got);
+    return traits_type::to_int_type(*gptr());
+  }
+
+  std::streamsize xsgetn(char *s, std::streamsize n) override {
+    const std::streamsize buffered =
+        std::min<std::streamsize>(n, egptr() - gptr());
+    std::memcpy(s, gptr(), buffered);
+    gbump(static_cast<int>(buffered));
+    if (buffered == n || !skip()) {
+      return buffered;
+    }
+
+    // Large reads skip the buffer, and are checksummed where they land
+    const size_t wanted = std::min<size_t>(n - buffered, m_remaining);
+    if (wanted < m_buffer.size()) {
+      return buffered + std::streambuf::xsgetn(s + buffered, n - buffered);
+    }
+
+    setg(m_buffer.data(), m_buffer.data(), m_buffer.data());
+    return buffered + load(s + buffered, wanted);
+  }
+
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                   std::ios_base::openmode which) override {
+    if (!(which & std::ios_base::in)) {
+      return pos_type(off_type(-1));
+    }
+
+    const off_type current =
+        m_skipTo ? *m_skipTo : loaded() - (egptr() - gptr());
+    const off_type target = dir == std::ios_base::beg   ? off - m_base
+                            : dir == std::ios_base::cur ? current + off
+                                                        : m_size + off;
+
+    const off_type bufferStart = loaded() - (egptr() - eback());
+    if (target < bufferStart || target > static_cast<off_type>(m_size)) {
+      return pos_type(off_type(-1));
+    }
+
+    if (target <= static_cast<off_type>(loaded())) {
+      m_skipTo.reset();
+      setg(eback(), egptr() - (loaded() - target), egptr());
+    } else {
+      m_skipTo = target;
+      setg(eback(), egptr(), egptr());
+    }
+
+    return pos_type(m_base + target);
+  }
+
+  pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+    return seekoff(off_type(pos), std::ios_base::beg, which);
+  }
+
+public:
+  ChecksumReader(std::streambuf &source, size_t size)
+      : m_source(source),
+        m_base(source.pubseekoff(0, std::ios_base::cur, std::ios_base::in)),
+        m_size(size), m_remaining(size) {
+    if (m_base == -1) {
+      m_base = 0;
+    }
+
+    setg(m_buffer.data(), m_buffer.data(), m_buffer.data());
+  }
+
+  /**
+   * Consume whatever hasn't been read yet and return the CRC32C of all
+   * `size` bytes. Returns nothing if the source ended early.
+   */
+  std::optional<uint32_t> finish() {
+    if (!skip()) {
+      return std::nullopt;
+    }
+
+    while (m_remaining > 0) {
+      setg(m_buffer.data(), m_buffer.data(), m_buffer.data());
+      if (traits_type::eq_int_type(underflow(), traits_type::eof())) {
+        return std::nullopt;
+      }
+    }
+
+    setg(m_buffer.data(), m_buffer.data(), m_buffer.data());
+    return m_crc;
+  }
+};
+
+} // namespace v3
+
+SLC_NS_END
+
+#endif
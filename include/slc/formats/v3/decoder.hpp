@@ -0,0 +1,152 @@
+#ifndef _SLC_V3_DECODER_HPP
+#define _SLC_V3_DECODER_HPP
+
+#include "slc/formats/v3/action.hpp"
+#include "slc/formats/v3/error.hpp"
+#include "slc/formats/v3/marker.hpp"
+#include "slc/formats/v3/section.hpp"
+#include "slc/util.hpp"
+
+#include <istream>
+#include <vector>
+
+SLC_NS_BEGIN
+
+namespace v3 {
+
+/**
+ * Decodes the actions of an action atom one section at a time.
+ *
+ * Only the actions of the section that's currently being consumed (and the
+ * ones back-references can still copy) are kept in memory, so this can be
+ * used to walk atoms that would be too large (or too wasteful) to decode into
+ * an [`ActionAtom`].
+ */
+class ActionDecoder {
+private:
+  std::istream &m_in;
+  std::vector<Action> m_buffer;
+  size_t m_position = 0;
+  uint64_t m_remaining;
+  // Decoded actions kept around for the next sections
+  size_t m_history;
+
+public:
+  // Whatever any supported atom version may have been encoded with
+  static constexpr EncodingOptions ANY_ENCODING =
+      EncodingOptions::forVersion(EncodingOptions::LATEST_VERSION);
+
+  /**
+   * Create a decoder for an action payload with a known action count.
+   * The stream has to be positioned right after the count.
+   *
+   * `encoding` is what the atom may have been encoded with (see its atom
+   * version); atoms without back-references need less memory to decode.
+   */
+  ActionDecoder(std::istream &in, uint64_t count,
+                EncodingOptions encoding = ANY_ENCODING)
+      : m_in(in), m_remaining(count),
+        m_history(encoding.m_backReferences
+                      ? BackReferenceMatcher::MAX_DISTANCE
+                      : 1) {}
+
+  /**
+   * Create a decoder from a stream positioned at the start of an action atom
+   * payload.
+   */
+  static ActionDecoder open(std::istream &in,
+                            EncodingOptions encoding = ANY_ENCODING) {
+    uint64_t count = util::binRead<uint64_t>(in);
+    return ActionDecoder(in, count, encoding);
+  }
+
+  /**
+   * Create a decoder that starts at the action a marker points at, without
+   * decoding anything before the marker's section.
+   *
+   * The stream has to be positioned right after the action count, `count`
+   * is the action count of the whole atom and `size` the size of the
+   * sections after it (after decompressing, for compressed atoms).
+   */
+  static Result<ActionDecoder> seek(std::istream &in, uint64_t count,
+                                    uint64_t size, const Marker &marker) {
+    if (marker.m_sectionAction > marker.m_action || marker.m_action > count) {
+      return std::unexpected("marker doesn't point into the action atom");
+    }
+
+    // Only markers after the last action point at the end of the sections
+    const bool atEnd = marker.m_sectionAction == count;
+    if (marker.m_offset > size || (marker.m_offset == size && !atEnd)) {
+      return std::unexpected("marker offset exceeds the action atom");
+    }
+
+    in.seekg(marker.m_offset, std::ios::cur);
+    if (!in) {
+      return std::unexpected("marker offset exceeds the action atom");
+    }
+
+    // Atoms with markers can't have back-references
+    ActionDecoder decoder(in, count - marker.m_sectionAction,
+                          EncodingOptions{});
+
+    // Looks just like the last action of a previous section
+    decoder.m_buffer.push_back(
+        Action(marker.m_baseFrame, 0, Action::ActionType::Bugpoint));
+    decoder.m_position = 1;
+
+    for (uint64_t i = marker.m_sectionAction; i < marker.m_action; i++) {
+      TRY(decoder.next());
+    }
+
+    return decoder;
+  }
+
+  /**
+   * Decode the next action.
+   *
+   * Returns a null pointer once all actions have been decoded. The pointer is
+   * valid until the next call.
+   */
+  Result<const Action *> next() {
+    if (m_position < m_buffer.size()) {
+      m_remaining--;
+      return &m_buffer[m_position++];
+    }
+
+    if (m_remaining == 0) {
+      return nullptr;
+    }
+
+    // Sections encode deltas relative to the previous action, and
+    // back-references copy from the ones before it, so those are kept around.
+    // With back-references they're only dropped once there are twice as many,
+    // so they aren't moved for every section
+    if (m_buffer.size() > (m_history == 1 ? 1 : 2 * m_history)) {
+      m_buffer.erase(m_buffer.begin(), m_buffer.end() - m_history);
+      m_position = m_buffer.size();
+    }
+
+    while (m_position >= m_buffer.size()) {
+      if (m_in.eof() || m_in.fail()) {
+        return std::unexpected(
+            "unexpected end of stream while decoding actions");
+      }
+
+      TRY(Section::read(m_in, m_buffer, m_buffer.size() + m_remaining));
+    }
+
+    m_remaining--;
+    return &m_buffer[m_position++];
+  }
+
+  /**
+   * How many actions are left to decode.
+   */
+  uint64_t remaining() const { return m_remaining; }
+};
+
+} // namespace v3
+
+SLC_NS_END
+
+#endif
@@ -0,0 +1,477 @@
+#ifndef _SLC_V3_ENCODER_HPP
+#define _SLC_V3_ENCODER_HPP
+
+#include "slc/formats/v3/action.hpp"
+#include "slc/formats/v3/error.hpp"
+#include "slc/formats/v3/instrumentation.hpp"
+#include "slc/formats/v3/marker.hpp"
+#include "slc/formats/v3/report.hpp"
+#include "slc/formats/v3/section.hpp"
+#include "slc/util.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <streambuf>
+#include <vector>
+
+SLC_NS_BEGIN
+
+namespace v3 {
+
+/**
+ * Encodes frame-sorted actions into sections.
+ *
+ * Actions can either be encoded all at once with [`write`], or pushed one at
+ * a time; in the latter case only a bounded window of actions is kept in
+ * memory and sections are written out as soon as nothing after them can
+ * change how they're encoded. Both produce exactly the same bytes.
+ *
+ * Encoding is reported to the `Instr` instrumentation policy, and to an
+ * [`EncodingReport`] if one is given.
+ */
+template <IsInstrumentation Instr = NoInstrumentation>
+class BasicActionEncoder {
+public:
+  // How many pending actions the encoder buffers before trying to flush.
+  // This has to be comfortably larger than the largest possible section group.
+  static constexpr size_t WINDOW_SIZE = 1 << 17;
+
+private:
+  static constexpr size_t MAX_SECTION_ACTIONS = 1 << 16;
+  // A back-reference costs its 2 byte header and up to 4 bytes of distance,
+  // and splits the input group it lands in, which costs another header. Short
+  // matches in dense inputs are mostly coincidental, and replacing them hides
+  // the raw deltas from the compressor (clicker grew by a third at 4)
+  static constexpr size_t MIN_BACK_REFERENCE_LENGTH = 16;
+
+  std::ostream &m_out;
+  std::vector<Action> m_pending;
+  std::vector<Section> m_sections;
+  EncodingReport *m_report;
+  EncodingOptions m_options;
+  // Only there when back-references are enabled
+  std::optional<BackReferenceMatcher> m_matcher;
+  uint64_t m_previousFrame = 0;
+  size_t m_count = 0;
+
+  std::vector<Marker> m_markers;
+  // Markers before this one have been resolved
+  size_t m_resolved = 0;
+  // Bytes of sections written so far
+  uint64_t m_written = 0;
+
+  // Swallows whatever is written to it
+  class NullBuffer : public std::streambuf {
+  protected:
+    int_type overflow(int_type c) override { return traits_type::not_eof(c); }
+    std::streamsize xsputn(const char *, std::streamsize n) override {
+      return n;
+    }
+  };
+
+  static inline bool swiftCompatible(std::span<const Action> actions,
+                                     size_t i) {
+    assert(i < actions.size());
+
+    return actions[i].delta() == 0 && !actions[i].m_holding &&
+           actions[i - 1].m_holding != actions[i].m_holding &&
+           actions[i - 1].m_player2 == actions[i].m_player2 &&
+           actions[i - 1].m_type == actions[i].m_type &&
+           actions[i].m_type == Action::ActionType::Jump;
+  }
+
+  static inline bool canJoin(std::span<const Action> actions, size_t count,
+                             size_t i) {
+    return i < (actions.size() - 1) && count < MAX_SECTION_ACTIONS &&
+           actions[i + 1].isPlayer() &&
+           actions[i + 1].getMinimumSize() == actions[i].getMinimumSize();
+  }
+
+public:
+  /**
+   * Split actions into sections.
+   *
+   * Unless `final` is set, the trailing group of actions whose encoding could
+   * still change with more actions is left alone. Returns how many actions
+   * were turned into sections.
+   *
+   * Back-references are only made if a `matcher` is given, which has to have
+   * encoded every action before these.
+   */
+  // "literally slc2"
+  static Result<size_t>
+  prepareSections(std::span<Action> actions, std::vector<Section> &sections,
+                  bool final = true, const EncodingOptions &options = {},
+                  BackReferenceMatcher *matcher = nullptr) {
+    ScopedPhase<Instr> timer(Phase::PrepareSections);
+
+    if (matcher) {
+      matcher->see(actions);
+    }
+
+    // The back-reference worth making at an action, which is empty if there's
+    // none. Unless `final` is set, that can't be told for the last actions yet
+    const auto reference =
+        [&](size_t i) -> std::optional<BackReferenceMatcher::Match> {
+      if (!final && actions.size() - i < BackReferenceMatcher::MAX_LENGTH) {
+        return std::nullopt;
+      }
+
+      const auto match = matcher->find(i);
+      if (match.m_length < MIN_BACK_REFERENCE_LENGTH) {
+        return BackReferenceMatcher::Match{};
+      }
+
+      return match;
+    };
+
+    size_t i = 0;
+    while (i < actions.size()) {
+      if (matcher) {
+        const auto match = reference(i);
+        if (!match) {
+          return i;
+        }
+
+        if (match->m_length != 0) {
+          sections.push_back(Section::backReference(*match));
+
+          i += match->m_length;
+          matcher->consume(actions, i);
+
+          continue;
+        }
+      }
+
+      if (!actions[i].isPlayer()) {
+        auto section = TRY(Section::special(actions[i]));
+
+        sections.push_back(std::move(section));
+
+        i++;
+
+        if (matcher) {
+          matcher->consume(actions, i);
+        }
+
+        continue;
+      }
+
+      uint32_t count = 1;
+      uint32_t pureCount = 1;
+      uint32_t swifts = 0;
+      uint32_t pureSwifts = 0;
+      size_t start = i;
+
+      uint8_t minSize = actions[i].getMinimumSize();
+
+      // Swift flags are recomputed on every pass; clearing them as the scan
+      // goes keeps stale flags from previous encodes out of the output
+      actions[i].m_swift = false;
+
+      while (canJoin(actions, pureCount, i)) {
+        // Groups end where a back-reference starts
+        if (matcher) {
+          const auto match = reference(i + 1);
+          if (!match) {
+            return start;
+          }
+
+          if (match->m_length != 0) {
+            break;
+          }
+        }
+
+        i++;
+        count++;
+
+        actions[i].m_swift = false;
+
+        if (swiftCompatible(actions, i)) {
+          actions[i - 1].m_swift = true;
+          actions[i].m_swift = true;
+          swifts++;
+        } else {
+          pureCount++;
+        }
+
+        if ((uint32_t)util::largestPowerOfTwo(pureCount) == pureCount) {
+          pureSwifts = swifts;
+        }
+      }
+
+      // The group ran into the end of the buffer, so more actions might
+      // still join it
+      if (!final && pureCount < MAX_SECTION_ACTIONS &&
+          i + 1 >= actions.size()) {
+        return start;
+      }
+
+      count--;
+
+      count = util::largestPowerOfTwo(pureCount);
+      i = start + count + pureSwifts;
+
+      Section s = Section::player(actions, start, i);
+      s.m_deltaSize = minSize;
+
+      const size_t inputs = s.m_playerInputs.size();
+
+      std::vector<Section> realSections;
+      {
+        ScopedPhase<Instr> rleTimer(Phase::RunLengthEncode);
+        realSections = s.runLengthEncode(options);
+      }
+
+      if (matcher) {
+        matcher->consume(actions, i);
+      }
+
+      if constexpr (Instr::enabled) {
+        size_t stored = 0;
+        for (const auto &section : realSections) {
+          stored += section.m_playerInputs.size();
+        }
+
+        Instr::runLengthEncoded(inputs, stored);
+      }
+
+      sections.insert(sections.end(), realSections.begin(), realSections.end());
+    }
+
+    return i;
+  }
+
+  /**
+   * Encode all given actions and write the resulting sections to a stream.
+   * If `report` is given, the encoding is added to it.
+   */
+  static Result<> write(std::ostream &out, std::span<Action> actions,
+                        EncodingReport *report = nullptr,
+                        const EncodingOptions &options = {}) {
+    std::vector<Section> sections;
+
+    std::optional<BackReferenceMatcher> matcher;
+    if (options.m_backReferences) {
+      matcher.emplace();
+    }
+
+    TRY(prepareSections(actions, sections, true, options,
+                        matcher ? &*matcher : nullptr));
+
+    writeSections(out, sections, report);
+
+    if (report) {
+      report->m_actions += actions.size();
+    }
+
+    return {};
+  }
+
+  /**
+   * Create an encoder for pushing actions one at a time.
+   * If `report` is given, the encoding is added to it as sections are written.
+   */
+  explicit BasicActionEncoder(std::ostream &out,
+                              EncodingReport *report = nullptr,
+                              EncodingOptions options = {})
+      : m_out(out), m_report(report), m_options(options) {
+    m_pending.reserve(WINDOW_SIZE);
+
+    if (m_options.m_backReferences) {
+      m_matcher.emplace();
+    }
+  }
+
+  /**
+   * Add an action to the end of the stream.
+   *
+   * Only the frame of the action is used; its delta is recalculated from the
+   * previously pushed action.
+   */
+  Result<> push(Action action) {
+    if (action.m_frame < m_previousFrame) {
+      return std::unexpected("action pushed to encoder is out of order");
+    }
+
+    action.recalculateDelta(m_previousFrame);
+    m_previousFrame = action.m_frame;
+    m_pending.push_back(action);
+    m_count++;
+
+    if (m_report) {
+      m_report->m_actions++;
+    }
+
+    if (m_pending.size() >= WINDOW_SIZE) {
+      TRY(flush(false));
+    }
+
+    return {};
+  }
+
+  /**
+   * Encode and write all remaining actions.
+   */
+  Result<> finish() {
+    // Decoding from a marker on can't copy what came before it
+    if (m_matcher && !m_markers.empty()) {
+      return std::unexpected(
+          "markers can't point into atoms with back-references");
+    }
+
+    TRY(flush(true));
+
+    // Markers after the last action point at the end of the sections
+    for (; m_resolved < m_markers.size(); m_resolved++) {
+      auto &marker = m_markers[m_resolved];
+      marker.m_offset = m_written;
+      marker.m_sectionAction = m_count;
+      marker.m_baseFrame = m_previousFrame;
+    }
+
+    return {};
+  }
+
+  /**
+   * How many actions have been pushed so far.
+   */
+  size_t count() const { return m_count; }
+
+  /**
+   * Add a marker pointing at the next action that's pushed.
+   *
+   * This only costs a few additions per section until the marker's section
+   * is written, so it's fine to call while recording. The markers are
+   * complete once [`finish`] returns; see [`markers`].
+   */
+  void mark(std::string name, uint64_t frame) {
+    m_markers.push_back(Marker{
+        .m_name = std::move(name), .m_frame = frame, .m_action = m_count});
+  }
+
+  /**
+   * The markers added with [`mark`], in the order they were added.
+   */
+  const std::vector<Marker> &markers() const { return m_markers; }
+
+  /**
+   * Fill in where given markers are once given actions are encoded.
+   *
+   * Only the frames of the markers have to be set; each of them points at the
+   * first action on or after its frame. This encodes the actions (without
+   * writing them anywhere), so when recording, [`mark`] the encoder instead.
+   */
+  static Result<> resolve(std::span<const Action> actions,
+                          std::span<Marker> markers,
+                          const EncodingOptions &options = {}) {
+    std::vector<size_t> order(markers.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::ranges::stable_sort(
+        order, {}, [&](size_t i) { return markers[i].m_frame; });
+
+    NullBuffer buffer;
+    std::ostream out(&buffer);
+    BasicActionEncoder encoder(out, nullptr, options);
+
+    size_t next = 0;
+    const auto markUpTo = [&](uint64_t frame) {
+      for (; next < order.size() && markers[order[next]].m_frame <= frame;
+           next++) {
+        const auto &marker = markers[order[next]];
+        encoder.mark(marker.m_name, marker.m_frame);
+      }
+    };
+
+    for (const auto &action : actions) {
+      markUpTo(action.m_frame);
+      TRY(encoder.push(action));
+    }
+
+    markUpTo(UINT64_MAX);
+    TRY(encoder.finish());
+
+    for (size_t i = 0; i < order.size(); i++) {
+      markers[order[i]] = std::move(encoder.m_markers[i]);
+    }
+
+    return {};
+  }
+
+private:
+  static void writeSections(std::ostream &out,
+                            const std::vector<Section> &sections,
+                            EncodingReport *report) {
+    ScopedPhase<Instr> timer(Phase::WriteSections);
+
+    for (const auto &section : sections) {
+      section.write(out);
+
+      if (report) {
+        report->add(section);
+      }
+
+      if constexpr (Instr::enabled) {
+        if (!section.m_markedForRemoval) {
+          Instr::section(section);
+        }
+      }
+    }
+  }
+
+  /**
+   * Fill in the markers pointing into the sections about to be written, out
+   * of the first `consumed` pending actions.
+   */
+  void resolveMarkers(size_t consumed) {
+    const uint64_t first = m_count - m_pending.size();
+    uint64_t action = first;
+
+    for (const auto &section : m_sections) {
+      if (m_resolved < m_markers.size() &&
+          m_markers[m_resolved].m_action < first + consumed) {
+        const uint64_t count = section.actionCount();
+
+        for (; m_resolved < m_markers.size() &&
+               m_markers[m_resolved].m_action < action + count;
+             m_resolved++) {
+          const Action &start = m_pending[action - first];
+
+          auto &marker = m_markers[m_resolved];
+          marker.m_offset = m_written;
+          marker.m_sectionAction = action;
+          marker.m_baseFrame = start.m_frame - start.delta();
+        }
+
+        action += count;
+      }
+
+      m_written += section.writtenSize();
+    }
+  }
+
+  Result<> flush(bool final) {
+    size_t consumed =
+        TRY(prepareSections(m_pending, m_sections, final, m_options,
+                            m_matcher ? &*m_matcher : nullptr));
+
+    resolveMarkers(consumed);
+    writeSections(m_out, m_sections, m_report);
+
+    m_sections.clear();
+    m_pending.erase(m_pending.begin(), m_pending.begin() + consumed);
+
+    return {};
+  }
+};
+
+using ActionEncoder = BasicActionEncoder<>;
+
+} // namespace v3
+
+SLC_NS_END
+
+#endif
@@ -10,12 +10,13 @@ SLC_NS_BEGIN
 
 namespace v3 {
 
+// Evaluates to the (moved out) value of a Result, or returns its error
 #define TRY(failable)                                                          \
   ({                                                                           \
     auto result = (failable);                                                  \
     if (!result)                                                               \
       return std::unexpected{result.error()};                                  \
-    *result;                                                                   \
+    *std::move(result);                                                        \
   })
 
 struct Error {
@@ -0,0 +1,97 @@
+#ifndef _SLC_V3_INSTRUMENTATION_HPP
+#define _SLC_V3_INSTRUMENTATION_HPP
+
+#include "slc/formats/v3/section.hpp"
+#include "slc/util.hpp"
+
+#include <chrono>
+#include <concepts>
+
+SLC_NS_BEGIN
+
+namespace v3 {
+
+/**
+ * Parts of encoding and decoding that get timed.
+ *
+ * Phases can nest; time spent in RunLengthEncode is also counted towards the
+ * PrepareSections phase it happens in.
+ */
+enum class Phase : uint8_t {
+  // Splitting actions into sections.
+  PrepareSections,
+  // Finding repeats in a group of player inputs.
+  RunLengthEncode,
+  // Writing finished sections to a stream.
+  WriteSections,
+  // Reading and decoding a whole atom.
+  ReadAtom,
+};
+
+/**
+ * An instrumentation policy.
+ *
+ * Hooks are static, so policies cost nothing to carry around; a policy that
+ * needs state can keep it in a (thread local) global and feed it to whatever
+ * collects metrics. When `enabled` is false, no hook is called and nothing is
+ * measured.
+ *
+ * - `phase` is called every time a phase finishes, with the time it took
+ * - `section` is called for every section that's written
+ * - `runLengthEncoded` is called every time a group of player inputs is run
+ *   length encoded, with how many inputs went in and how many are stored
+ */
+template <typename T>
+concept IsInstrumentation = requires(Phase phase,
+                                     std::chrono::nanoseconds elapsed,
+                                     const Section &section, size_t count) {
+  { T::enabled } -> std::convertible_to<bool>;
+  T::phase(phase, elapsed);
+  T::section(section);
+  T::runLengthEncoded(count, count);
+};
+
+/**
+ * The default instrumentation policy, which does nothing.
+ */
+struct NoInstrumentation {
+  static constexpr bool enabled = false;
+
+  static void phase(Phase, std::chrono::nanoseconds) {}
+  static void section(const Section &) {}
+  static void runLengthEncoded(size_t, size_t) {}
+};
+
+/**
+ * Reports the time between its construction and destruction as a phase.
+ */
+template <IsInstrumentation Instr> class ScopedPhase {
+private:
+  using Clock = std::chrono::steady_clock;
+
+  Phase m_phase;
+  Clock::time_point m_start;
+
+public:
+  explicit ScopedPhase(Phase phase) : m_phase(phase) {
+    if constexpr (Instr::enabled) {
+      m_start = Clock::now();
+    }
+  }
+
+  ~ScopedPhase() {
+    if constexpr (Instr::enabled) {
+      Instr::phase(m_phase, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                Clock::now() - m_start));
+    }
+  }
+
+  ScopedPhase(const ScopedPhase &) = delete;
+  ScopedPhase &operator=(const ScopedPhase &) = delete;
+};
+
+} // namespace v3
+
+SLC_NS_END
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef _SLC_V3_MARKER_HPP
+#define _SLC_V3_MARKER_HPP
+
+#include "slc/formats/v3/atom.hpp"
+#include "slc/formats/v3/error.hpp"
+#include "slc/util.hpp"
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+
+SLC_NS_BEGIN
+
+namespace v3 {
+
+/**
+ * A named frame in a replay, like a practice checkpoint, a part of a level
+ * or the start of an attempt.
+ *
+ * Besides its frame, a marker knows where its action is in the encoded
+ * action atom, so decoding can start right there; see
+ * [`ActionDecoder::seek`]. These are filled in by the encoder, see
+ * [`BasicActionEncoder::mark`] and [`BasicActionEncoder::resolve`].
+ */
+struct Marker {
+  std::string m_name;
+  uint64_t m_frame = 0;
+
+  // Index of the action the marker points at, which is the first one on or
+  // after its frame.
+  uint64_t m_action = 0;
+
+  // Offset of the section holding that action from the first section of the
+  // action atom (after decompressing, for compressed atoms).
+  uint64_t m_offset = 0;
+  // Index of the first action of that section.
+  uint64_t m_sectionAction = 0;
+  // Frame of the action before that, which the section's deltas are
+  // relative to.
+  uint64_t m_baseFrame = 0;
+};
+
+/**
+ * The atom holding the markers of a replay.
+ *
+ * Markers refer to the action atom that comes before this atom.
+ */
+struct MarkerAtom {
+  static inline constexpr AtomId id = AtomId::Marker;
+  size_t size;
+
+  std::vector<Marker> m_markers;
+
+private:
+  static constexpr size_t FIXED_SIZE = 5 * sizeof(uint64_t) + sizeof(uint16_t);
+
+public:
+  /**
+   * Read a marker atom from a stream of given size.
+   * It's recommended to use this function from an atom registry.
+   * See [`AtomRegistry::readAll`].
+   */
+  static Result<MarkerAtom> read(std::istream &in, size_t size) {
+    MarkerAtom a;
+    a.size = size;
+
+    if (size < sizeof(uint64_t)) {
+      return std::unexpected("truncated MarkerAtom");
+    }
+
+    const uint64_t count = util::binRead<uint64_t>(in);
+    size_t remaining = size - sizeof(uint64_t);
+    if (count > remaining / FIXED_SIZE) {
+      return std::unexpected("MarkerAtom holds more markers than it can fit");
+    }
+
+    a.m_markers.resize(count);
+    for (auto &marker : a.m_markers) {
+      marker.m_frame = util::binRead<uint64_t>(in);
+      marker.m_action = util::binRead<uint64_t>(in);
+      marker.m_offset = util::binRead<uint64_t>(in);
+      marker.m_sectionAction = util::binRead<uint64_t>(in);
+      marker.m_baseFrame = util::binRead<uint64_t>(in);
+
+      const uint16_t nameSize = util::binRead<uint16_t>(in);
+      remaining -= FIXED_SIZE;
+      if (nameSize > remaining) {
+        return std::unexpected("marker name exceeds MarkerAtom size");
+      }
+
+      marker.m_name.resize(nameSize);
+      in.read(marker.m_name.data(), nameSize);
+      remaining -= nameSize;
+    }
+
+    if (!in) {
+      return std::unexpected(
+          "unexpected end of stream while reading MarkerAtom");
+    }
+
+    // Leave room for more fields in later versions
+    in.seekg(remaining, std::ios::cur);
+
+    return a;
+  }
+
+  /**
+   * Write a marker atom to a stream.
+   * It's recommended to use this function from an atom registry.
+   * See [`AtomRegistry::writeAll`].
+   */
+  Result<> write(std::ostream &out) const {
+    util::binWrite<uint64_t>(out, m_markers.size());
+
+    for (const auto &marker : m_markers) {
+      if (marker.m_name.size() > UINT16_MAX) {
+        return std::unexpected("marker name is too long");
+      }
+
+      util::binWrite(out, marker.m_frame);
+      util::binWrite(out, marker.m_action);
+      util::binWrite(out, marker.m_offset);
+      util::binWrite(out, marker.m_sectionAction);
+      util::binWrite(out, marker.m_baseFrame);
+      util::binWrite(out, static_cast<uint16_t>(marker.m_name.size()));
+      out.write(marker.m_name.data(), marker.m_name.size());
+    }
+
+    return {};
+  }
+
+  /**
+   * Add a marker on given frame.
+   * Where it is in the action atom still has to be filled in.
+   */
+  void add(std::string name, uint64_t frame) {
+    m_markers.push_back(Marker{.m_name = std::move(name), .m_frame = frame});
+  }
+
+  /**
+   * Find the first marker with given name.
+   */
+  const Marker *find(std::string_view name) const {
+    auto it = std::ranges::find(m_markers, name, &Marker::m_name);
+    return it == m_markers.end() ? nullptr : &*it;
+  }
+
+  /**
+   * The number of markers.
+   */
+  size_t length() const { return m_markers.size(); }
+};
+
+} // namespace v3
+
+SLC_NS_END
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef _SLC_V3_MERGE_HPP
+#define _SLC_V3_MERGE_HPP
+
+#include "slc/formats/v3/action.hpp"
+#include "slc/formats/v3/builtin.hpp"
+#include "slc/formats/v3/decoder.hpp"
+#include "slc/formats/v3/error.hpp"
+#include "slc/util.hpp"
+
+#include <algorithm>
+#include <concepts>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+SLC_NS_BEGIN
+
+namespace v3 {
+
+/**
+ * Anything that hands out frame-sorted actions one at a time, like an
+ * [`ActionDecoder`]. `next` returns a null pointer once it runs out, and the
+ * pointer it returns only has to be valid until the next call.
+ */
+template <typename T>
+concept IsActionSource = requires(T &source) {
+  { source.next() } -> std::same_as<Result<const Action *>>;
+};
+
+/**
+ * An action source over actions that are already in memory, like the
+ * actions of an [`ActionAtom`].
+ */
+class ActionCursor {
+private:
+  std::span<const Action> m_actions;
+  size_t m_position = 0;
+
+public:
+  explicit ActionCursor(std::span<const Action> actions)
+      : m_actions(actions) {}
+
+  Result<const Action *> next() {
+    if (m_position == m_actions.size()) {
+      return nullptr;
+    }
+
+    return &m_actions[m_position++];
+  }
+};
+
+/**
+ * Merges any number of frame-sorted action sources into one, with a k-way
+ * merge over a heap of their next actions.
+ *
+ * Actions on the same frame come out in source order (everything from the
+ * first source before the second, and so on), and keep their order within a
+ * source. Deltas are recalculated for the merged order, so the merged
+ * actions can go straight into an [`ActionEncoder`]:
+ *
+ * ```cpp
+ * ActionMerger merger(std::vector{&p1, &p2});
+ * while (auto action = TRY(merger.next())) {
+ *   TRY(encoder.push(*action));
+ * }
+ * ```
+ *
+ * Sources are pointed to, not owned, and only ever advanced one action past
+ * what has been merged.
+ */
+template <IsActionSource Source> class ActionMerger {
+private:
+  struct Head {
+    const Action *m_action;
+    size_t m_source;
+  };
+
+  std::vector<Source *> m_sources;
+  // A min-heap of the next action of every source that has one left
+  std::vector<Head> m_heap;
+  bool m_started = false;
+
+  Action m_current;
+  size_t m_currentSource = 0;
+  uint64_t m_previousFrame = 0;
+
+  static bool after(const Head &lhs, const Head &rhs) {
+    if (lhs.m_action->m_frame != rhs.m_action->m_frame) {
+      return lhs.m_action->m_frame > rhs.m_action->m_frame;
+    }
+
+    return lhs.m_source > rhs.m_source;
+  }
+
+  Result<> advance(size_t source) {
+    const Action *action = TRY(m_sources[source]->next());
+    if (action) {
+      m_heap.push_back(Head{action, source});
+      std::push_heap(m_heap.begin(), m_heap.end(), after);
+    }
+
+    return {};
+  }
+
+public:
+  explicit ActionMerger(std::vector<Source *> sources)
+      : m_sources(std::move(sources)) {
+    m_heap.reserve(m_sources.size());
+  }
+
+  /**
+   * Get the next action in frame order.
+   *
+   * Returns a null pointer once every source has run out. The pointer is
+   * valid until the next call. Fails if a source fails, or isn't sorted.
+   */
+  Result<const Action *> next() {
+    if (!m_started) {
+      m_started = true;
+      for (size_t i = 0; i < m_sources.size(); i++) {
+        TRY(advance(i));
+      }
+    }
+
+    if (m_heap.empty()) {
+      return nullptr;
+    }
+
+    std::pop_heap(m_heap.begin(), m_heap.end(), after);
+    const Head head = m_heap.back();
+    m_heap.pop_back();
+
+    if (head.m_action->m_frame < m_previousFrame) {
+      return std::unexpected("merged action source isn't sorted by frame");
+    }
+
+    // The source may reuse the action's memory once it's advanced
+    m_current = *head.m_action;
+    m_current.recalculateDelta(m_previousFrame);
+    m_previousFrame = m_current.m_frame;
+    m_currentSource = head.m_source;
+
+    TRY(advance(head.m_source));
+
+    return &m_current;
+  }
+
+  /**
+   * Index of the source the last action came from.
+   */
+  size_t source() const { return m_currentSource; }
+};
+
+/**
+ * Merge frame-sorted action atoms into one, see [`ActionMerger`].
+ */
+template <IsInstrumentation Instr = NoInstrumentation>
+Result<BasicActionAtom<Instr>>
+merge(std::type_identity_t<std::span<const BasicActionAtom<Instr> *const>>
+          atoms) {
+  std::vector<ActionCursor> cursors;
+  cursors.reserve(atoms.size());
+
+  size_t total = 0;
+  for (const auto *atom : atoms) {
+    cursors.emplace_back(atom->m_actions);
+    total += atom->m_actions.size();
+  }
+
+  std::vector<ActionCursor *> sources;
+  for (auto &cursor : cursors) {
+    sources.push_back(&cursor);
+  }
+
+  BasicActionAtom<Instr> merged;
+  merged.m_actions.reserve(total);
+
+  ActionMerger merger(std::move(sources));
+  while (const Action *action = TRY(merger.next())) {
+    merged.m_actions.push_back(*action);
+  }
+
+  return merged;
+}
+
+} // namespace v3
+
+SLC_NS_END
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef _SLC_V3_METADATA_HPP
 #define _SLC_V3_METADATA_HPP
 
+#include "slc/formats/v3/checksum.hpp"
 #include "slc/util.hpp"
 
 #include <expected>
@@ -28,7 +29,24 @@ struct Metadata {
    */
   uint32_t m_randomnessAlgorithm = 0;
 
-  char __padding[36] = {0};
+  /**
+   * CRC32C of the metadata, computed with this field set to 0.
+   * 0 means the metadata isn't checksummed.
+   */
+  uint32_t m_checksum = 0;
+
+  char __padding[32] = {0};
+
+  /**
+   * Compute the checksum of this metadata.
+   */
+  uint32_t computeChecksum() const {
+    Metadata copy = *this;
+    copy.m_checksum = 0;
+
+    return crc32c::compute(std::span(
+        reinterpret_cast<const uint8_t *>(&copy), sizeof(Metadata)));
+  }
 };
 
 static_assert(sizeof(Metadata) == METADATA_SIZE);
@@ -0,0 +1,566 @@
+#ifndef _SLC_V3_RANS_HPP
+#define _SLC_V3_RANS_HPP
+
+#include "slc/formats/v3/error.hpp"
+#include "slc/util.hpp"
+
+#include <array>
+#include <bit>
+#include <cstring>
+#include <span>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+SLC_NS_BEGIN
+
+namespace v3 {
+
+/**
+ * Order-0 byte-wise rANS entropy coding.
+ *
+ * Symbols are interleaved over several coder states so decoding isn't bound by
+ * the latency of a single state's dependency chain: 8 of them, or 64 for data
+ * of at least [`WIDE_SIZE`] bytes, which are decoded as SIMD vectors where
+ * the CPU has them. Encoded data looks like:
+ *
+ * - 32 bytes: bitmap of which byte values occur
+ * - 2 bytes per occurring byte value: its normalized frequency
+ * - 4 bytes per state: the initial decoder states
+ * - the 16-bit renormalization words, in the order the decoder consumes them
+ */
+namespace rans {
+
+template <typename T> inline T load(const uint8_t *ptr) {
+  T value;
+  std::memcpy(&value, ptr, sizeof(T));
+  return value;
+}
+
+template <typename T> inline void store(uint8_t *ptr, T value) {
+  std::memcpy(ptr, &value, sizeof(T));
+}
+
+// Frequencies are normalized to 1 << PROB_BITS.
+constexpr uint32_t PROB_BITS = 12;
+constexpr uint32_t PROB_SCALE = 1u << PROB_BITS;
+// Lower bound of the normalized state interval; states are renormalized a
+// 16-bit word at a time.
+constexpr uint32_t RANS_L = 1u << 16;
+
+constexpr size_t STREAMS = 8;
+// A vector of states is bound by the latency of its table gather, so SIMD
+// decoders need several vectors in flight. The extra states cost 4 bytes
+// each, which only pays off for larger data.
+constexpr size_t WIDE_STREAMS = 64;
+constexpr size_t WIDE_SIZE = 64 * 1024;
+
+/**
+ * How many states data of given size is interleaved over.
+ */
+constexpr size_t streamsFor(size_t size) {
+  return size >= WIDE_SIZE ? WIDE_STREAMS : STREAMS;
+}
+
+struct Table {
+  std::array<uint16_t, 256> m_freq{};
+  std::array<uint16_t, 256> m_start{};
+
+  /**
+   * Build a table for given data, with every byte value that occurs getting
+   * a frequency of at least 1.
+   */
+  static Table build(std::span<const uint8_t> data) {
+    std::array<uint64_t, 256> counts{};
+    for (uint8_t byte : data) {
+      counts[byte]++;
+    }
+
+    Table t;
+    uint32_t total = 0;
+    for (size_t i = 0; i < 256; i++) {
+      if (counts[i] == 0) {
+        continue;
+      }
+
+      t.m_freq[i] = std::max<uint64_t>(1, counts[i] * PROB_SCALE / data.size());
+      total += t.m_freq[i];
+    }
+
+    // Rounding leaves the total a bit off; take it out of (or give it to) the
+    // most frequent symbols, which costs the least
+    while (total != PROB_SCALE) {
+      size_t largest = 0;
+      for (size_t i = 1; i < 256; i++) {
+        if (t.m_freq[i] > t.m_freq[largest]) {
+          largest = i;
+        }
+      }
+
+      if (total > PROB_SCALE) {
+        t.m_freq[largest]--;
+        total--;
+      } else {
+        t.m_freq[largest]++;
+        total++;
+      }
+    }
+
+    t.computeStarts();
+    return t;
+  }
+
+  void computeStarts() {
+    uint32_t start = 0;
+    for (size_t i = 0; i < 256; i++) {
+      m_start[i] = start;
+      start += m_freq[i];
+    }
+  }
+
+  void write(std::vector<uint8_t> &out) const {
+    std::array<uint8_t, 32> bitmap{};
+    for (size_t i = 0; i < 256; i++) {
+      if (m_freq[i] != 0) {
+        bitmap[i / 8] |= 1 << (i % 8);
+      }
+    }
+
+    out.insert(out.end(), bitmap.begin(), bitmap.end());
+
+    for (size_t i = 0; i < 256; i++) {
+      if (m_freq[i] != 0) {
+        out.push_back(m_freq[i] & 0xFF);
+        out.push_back(m_freq[i] >> 8);
+      }
+    }
+  }
+
+  static Result<Table> read(std::span<const uint8_t> in, size_t &pos) {
+    if (in.size() - pos < 32) {
+      return std::unexpected("truncated rANS frequency table");
+    }
+
+    const uint8_t *bitmap = in.data() + pos;
+    pos += 32;
+
+    Table t;
+    uint32_t total = 0;
+    for (size_t i = 0; i < 256; i++) {
+      if ((bitmap[i / 8] & (1 << (i % 8))) == 0) {
+        continue;
+      }
+
+      if (in.size() - pos < 2) {
+        return std::unexpected("truncated rANS frequency table");
+      }
+
+      t.m_freq[i] = in[pos] | (in[pos + 1] << 8);
+      pos += 2;
+
+      if (t.m_freq[i] == 0) {
+        return std::unexpected("invalid rANS frequency table");
+      }
+
+      total += t.m_freq[i];
+    }
+
+    if (total != PROB_SCALE) {
+      return std::unexpected("invalid rANS frequency table");
+    }
+
+    t.computeStarts();
+    return t;
+  }
+};
+
+/**
+ * Entropy code given data.
+ */
+inline std::vector<uint8_t> encode(std::span<const uint8_t> data) {
+  std::vector<uint8_t> out;
+  if (data.empty()) {
+    return out;
+  }
+
+  const Table table = Table::build(data);
+  table.write(out);
+
+  const size_t streams = streamsFor(data.size());
+
+  // rANS is last in, first out; the stream is built back to front, with room
+  // for every symbol taking up a word plus the final states
+  std::vector<uint16_t> words(data.size() + STREAMS * 2);
+  uint16_t *ptr = words.data() + words.size();
+
+  std::array<uint32_t, WIDE_STREAMS> states;
+  states.fill(RANS_L);
+
+  for (size_t i = data.size(); i-- > 0;) {
+    const uint8_t symbol = data[i];
+    const uint32_t freq = table.m_freq[symbol];
+    uint32_t &x = states[i % streams];
+
+    // Largest state that still fits in 32 bits after encoding the symbol
+    const uint64_t max = static_cast<uint64_t>((RANS_L >> PROB_BITS) << 16) * freq;
+    if (x >= max) {
+      *--ptr = static_cast<uint16_t>(x);
+      x >>= 16;
+    }
+
+    x = ((x / freq) << PROB_BITS) + (x % freq) + table.m_start[symbol];
+  }
+
+  const size_t tableSize = out.size();
+  const size_t streamWords = words.data() + words.size() - ptr;
+  out.resize(tableSize + streams * 4 + streamWords * 2);
+
+  uint8_t *dst = out.data() + tableSize;
+  for (size_t i = 0; i < streams; i++) {
+    store(dst, states[i]);
+    dst += 4;
+  }
+
+  for (size_t i = 0; i < streamWords; i++) {
+    store(dst, ptr[i]);
+    dst += 2;
+  }
+
+  return out;
+}
+
+using States = std::array<uint32_t, WIDE_STREAMS>;
+
+/**
+ * Decoding table, indexed by the low `PROB_BITS` bits of a state.
+ *
+ * The frequency and start of the slot's symbol are folded into
+ * `freq << 16 | (slot - start)`, so decoding a symbol takes a single
+ * multiply-add.
+ */
+struct DecodeTable {
+  std::vector<uint32_t> m_steps;
+  std::vector<uint8_t> m_symbols;
+
+  explicit DecodeTable(const Table &table)
+      : m_steps(PROB_SCALE), m_symbols(PROB_SCALE) {
+    for (size_t s = 0; s < 256; s++) {
+      for (uint32_t j = 0; j < table.m_freq[s]; j++) {
+        m_steps[table.m_start[s] + j] =
+            static_cast<uint32_t>(table.m_freq[s]) << 16 | j;
+        m_symbols[table.m_start[s] + j] = static_cast<uint8_t>(s);
+      }
+    }
+  }
+
+  /**
+   * The table SIMD decoders gather from, which also holds the symbol of
+   * each slot: `symbol << 24 | (freq - 1) << 12 | (slot - start)`.
+   */
+  std::vector<uint32_t> packed() const {
+    std::vector<uint32_t> packed(PROB_SCALE);
+    for (size_t slot = 0; slot < PROB_SCALE; slot++) {
+      const uint32_t freq = m_steps[slot] >> 16;
+      packed[slot] = static_cast<uint32_t>(m_symbols[slot]) << 24 |
+                     (freq - 1) << PROB_BITS | (m_steps[slot] & 0xFFFF);
+    }
+
+    return packed;
+  }
+};
+
+/**
+ * Decode a symbol from a state, without renormalizing it.
+ */
+inline uint8_t decodeSymbol(uint32_t &x, const uint32_t *steps,
+                            const uint8_t *symbols) {
+  const uint32_t slot = x & (PROB_SCALE - 1);
+  const uint32_t step = steps[slot];
+  x = (step >> 16) * (x >> PROB_BITS) + (step & 0xFFFF);
+  return symbols[slot];
+}
+
+/**
+ * Decode a symbol from each of `STREAMS` states, then renormalize them in
+ * order.
+ *
+ * A state takes in at most one word per symbol, so as long as there's
+ * `2 * STREAMS` bytes of input left, this needs no bounds checks; it needs no
+ * branches either. Decoding every state before renormalizing any keeps the
+ * table lookups independent of the input pointer. With more states, a round
+ * decodes as several of these, one after another.
+ */
+template <size_t... I>
+inline void decodeRound(uint32_t *x, const uint32_t *steps,
+                        const uint8_t *symbols, uint8_t *dst,
+                        const uint8_t *&ptr, std::index_sequence<I...>) {
+  ((dst[I] = decodeSymbol(x[I], steps, symbols)), ...);
+
+  const auto renormalize = [&ptr](uint32_t &x) {
+    const uint32_t refill = x < RANS_L;
+    const uint32_t word = load<uint16_t>(ptr);
+    ptr += refill * 2;
+    x = (x << (refill * 16)) | (word & (0u - refill));
+  };
+
+  (renormalize(x[I]), ...);
+}
+
+#if defined(__x86_64__)
+
+/**
+ * For every mask of AVX2 lanes that need a word, the index of the word each
+ * of those lanes takes.
+ */
+constexpr std::array<std::array<uint32_t, 8>, 256> makeRefillPermutes() {
+  std::array<std::array<uint32_t, 8>, 256> permutes{};
+
+  for (size_t mask = 0; mask < 256; mask++) {
+    uint32_t next = 0;
+    for (size_t lane = 0; lane < 8; lane++) {
+      if (mask & (1 << lane)) {
+        permutes[mask][lane] = next++;
+      }
+    }
+  }
+
+  return permutes;
+}
+
+alignas(32) inline constexpr auto REFILL_PERMUTES = makeRefillPermutes();
+
+/**
+ * Decode whole rounds of [`WIDE_STREAMS`] symbols with AVX2, as long as
+ * there's `2 * WIDE_STREAMS` bytes of input left, and return how many symbols
+ * were decoded. Renormalization words go to the refilled lanes of a vector in
+ * order, through a permute picked by the mask of those lanes.
+ */
+__attribute__((target("avx2"))) inline size_t
+decodeWideAVX2(uint32_t *states, const uint32_t *table, uint8_t *dst,
+               size_t size, const uint8_t *&ptr, const uint8_t *end) {
+  constexpr size_t VECTORS = WIDE_STREAMS / 8;
+
+  __m256i x[VECTORS];
+  for (size_t v = 0; v < VECTORS; v++) {
+    x[v] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(states) + v);
+  }
+
+  const __m256i slotMask = _mm256_set1_epi32(PROB_SCALE - 1);
+  const __m256i one = _mm256_set1_epi32(1);
+  // There's no unsigned compare, so both sides get their sign bit flipped
+  const __m256i signBit = _mm256_set1_epi32(0x80000000);
+  const __m256i lower = _mm256_set1_epi32(RANS_L ^ 0x80000000);
+  // The symbol bytes of each 128-bit half, to the front of it
+  const __m256i symbolBytes =
+      _mm256_setr_epi8(3, 7, 11, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                       -1, -1, 3, 7, 11, 15, -1, -1, -1, -1, -1, -1, -1, -1,
+                       -1, -1, -1, -1);
+
+  size_t i = 0;
+  while (size - i >= WIDE_STREAMS &&
+         end - ptr >= static_cast<ptrdiff_t>(2 * WIDE_STREAMS)) {
+    for (size_t v = 0; v < VECTORS; v++) {
+      const __m256i slot = _mm256_and_si256(x[v], slotMask);
+      const __m256i entry = _mm256_i32gather_epi32(
+          reinterpret_cast<const int *>(table), slot, 4);
+
+      const __m256i freq = _mm256_add_epi32(
+          _mm256_and_si256(_mm256_srli_epi32(entry, PROB_BITS), slotMask),
+          one);
+      x[v] = _mm256_add_epi32(
+          _mm256_mullo_epi32(freq, _mm256_srli_epi32(x[v], PROB_BITS)),
+          _mm256_and_si256(entry, slotMask));
+
+      const __m256i symbols = _mm256_shuffle_epi8(entry, symbolBytes);
+      const uint64_t packed =
+          static_cast<uint32_t>(_mm256_cvtsi256_si32(symbols)) |
+          static_cast<uint64_t>(
+              static_cast<uint32_t>(_mm256_extract_epi32(symbols, 4)))
+              << 32;
+      store(dst + i + v * 8, packed);
+    }
+
+    for (size_t v = 0; v < VECTORS; v++) {
+      const __m256i refill =
+          _mm256_cmpgt_epi32(lower, _mm256_xor_si256(x[v], signBit));
+      const int mask = _mm256_movemask_ps(_mm256_castsi256_ps(refill));
+
+      const __m256i words = _mm256_cvtepu16_epi32(
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr)));
+      const __m256i permuted = _mm256_permutevar8x32_epi32(
+          words, _mm256_load_si256(reinterpret_cast<const __m256i *>(
+                     REFILL_PERMUTES[mask].data())));
+
+      x[v] = _mm256_blendv_epi8(
+          x[v], _mm256_or_si256(_mm256_slli_epi32(x[v], 16), permuted),
+          refill);
+      ptr += 2 * std::popcount(static_cast<uint32_t>(mask));
+    }
+
+    i += WIDE_STREAMS;
+  }
+
+  for (size_t v = 0; v < VECTORS; v++) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(states) + v, x[v]);
+  }
+
+  return i;
+}
+
+/**
+ * Decode whole rounds of [`WIDE_STREAMS`] symbols with AVX-512, like
+ * [`decodeWideAVX2`]. Renormalization words are expanded straight into the
+ * low halves of the refilled lanes.
+ */
+__attribute__((target("avx512f,avx512bw,avx512vbmi2,bmi2"))) inline size_t
+decodeWideAVX512(uint32_t *states, const uint32_t *table, uint8_t *dst,
+                 size_t size, const uint8_t *&ptr, const uint8_t *end) {
+  constexpr size_t VECTORS = WIDE_STREAMS / 16;
+
+  __m512i x[VECTORS];
+  for (size_t v = 0; v < VECTORS; v++) {
+    x[v] = _mm512_loadu_si512(states + v * 16);
+  }
+
+  const __m512i slotMask = _mm512_set1_epi32(PROB_SCALE - 1);
+  const __m512i one = _mm512_set1_epi32(1);
+  const __m512i lower = _mm512_set1_epi32(RANS_L);
+
+  size_t i = 0;
+  while (size - i >= WIDE_STREAMS &&
+         end - ptr >= static_cast<ptrdiff_t>(2 * WIDE_STREAMS)) {
+    for (size_t v = 0; v < VECTORS; v++) {
+      const __m512i slot = _mm512_and_si512(x[v], slotMask);
+      const __m512i entry = _mm512_i32gather_epi32(slot, table, 4);
+
+      const __m512i freq = _mm512_add_epi32(
+          _mm512_and_si512(_mm512_srli_epi32(entry, PROB_BITS), slotMask),
+          one);
+      x[v] = _mm512_add_epi32(
+          _mm512_mullo_epi32(freq, _mm512_srli_epi32(x[v], PROB_BITS)),
+          _mm512_and_si512(entry, slotMask));
+
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + v * 16),
+                       _mm512_cvtepi32_epi8(_mm512_srli_epi32(entry, 24)));
+    }
+
+    for (size_t v = 0; v < VECTORS; v++) {
+      const __mmask16 refill = _mm512_cmplt_epu32_mask(x[v], lower);
+      // One mask bit per 16-bit word, of which the low ones get refilled
+      const __mmask32 words = _pdep_u32(refill, 0x55555555);
+
+      x[v] = _mm512_mask_or_epi32(x[v], refill, _mm512_slli_epi32(x[v], 16),
+                                  _mm512_maskz_expandloadu_epi16(words, ptr));
+      ptr += 2 * std::popcount(words);
+    }
+
+    i += WIDE_STREAMS;
+  }
+
+  for (size_t v = 0; v < VECTORS; v++) {
+    _mm512_storeu_si512(states + v * 16, x[v]);
+  }
+
+  return i;
+}
+
+#endif
+
+using DecodeWideFn = size_t (*)(uint32_t *, const uint32_t *, uint8_t *,
+                                size_t, const uint8_t *&, const uint8_t *);
+
+/**
+ * The SIMD decoder for [`WIDE_STREAMS`] states this CPU can run, if any.
+ */
+inline DecodeWideFn selectDecodeWide() {
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+      __builtin_cpu_supports("avx512vbmi2") && __builtin_cpu_supports("bmi2")) {
+    return &decodeWideAVX512;
+  }
+
+  if (__builtin_cpu_supports("avx2")) {
+    return &decodeWideAVX2;
+  }
+#endif
+
+  return nullptr;
+}
+
+/**
+ * Decode data produced by [`encode`] into `out`, which has to have the size
+ * of the original data.
+ */
+inline Result<> decode(std::span<const uint8_t> in, std::span<uint8_t> out) {
+  if (out.empty()) {
+    return {};
+  }
+
+  size_t pos = 0;
+  const Table table = TRY(Table::read(in, pos));
+
+  const DecodeTable decodeTable(table);
+
+  const size_t streams = streamsFor(out.size());
+  if (in.size() - pos < streams * 4) {
+    return std::unexpected("truncated rANS stream");
+  }
+
+  States x;
+  for (size_t i = 0; i < streams; i++) {
+    x[i] = load<uint32_t>(in.data() + pos);
+    pos += 4;
+  }
+
+  const uint8_t *ptr = in.data() + pos;
+  const uint8_t *end = in.data() + in.size();
+  // Everything used in the hot loop is local, so byte stores to the output
+  // can't alias (and force reloads of) any of it
+  const uint32_t *steps = decodeTable.m_steps.data();
+  const uint8_t *symbols = decodeTable.m_symbols.data();
+  uint8_t *dst = out.data();
+
+  size_t i = 0;
+
+  static const DecodeWideFn decodeWide = selectDecodeWide();
+  if (streams == WIDE_STREAMS && decodeWide) {
+    const std::vector<uint32_t> packed = decodeTable.packed();
+    i = decodeWide(x.data(), packed.data(), dst, out.size(), ptr, end);
+  }
+
+  // Rounds over more states decode as several rounds over `STREAMS` of them
+  while (out.size() - i >= STREAMS &&
+         end - ptr >= static_cast<ptrdiff_t>(2 * STREAMS)) {
+    decodeRound(x.data() + i % streams, steps, symbols, dst + i, ptr,
+                std::make_index_sequence<STREAMS>{});
+    i += STREAMS;
+  }
+
+  for (; i < out.size(); i++) {
+    uint32_t &state = x[i % streams];
+    dst[i] = decodeSymbol(state, steps, symbols);
+
+    if (state < RANS_L) {
+      if (end - ptr < 2) {
+        return std::unexpected("truncated rANS stream");
+      }
+
+      state = (state << 16) | load<uint16_t>(ptr);
+      ptr += 2;
+    }
+  }
+
+  return {};
+}
+
+} // namespace rans
+
+} // namespace v3
+
+SLC_NS_END
+
+#endif
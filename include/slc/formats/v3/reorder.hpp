@@ -0,0 +1,203 @@
+#ifndef _SLC_V3_REORDER_HPP
+#define _SLC_V3_REORDER_HPP
+
+#include "slc/formats/v3/action.hpp"
+#include "slc/formats/v3/builtin.hpp"
+#include "slc/formats/v3/error.hpp"
+#include "slc/formats/v3/instrumentation.hpp"
+#include "slc/util.hpp"
+
+#include <algorithm>
+#include <vector>
+
+SLC_NS_BEGIN
+
+namespace v3 {
+
+/**
+ * What a [`BasicReorderBuffer`] did with the actions given to it.
+ */
+struct ReorderStats {
+  // Actions appended to the atom.
+  size_t m_emitted = 0;
+  // Actions that arrived after a later action, but were put back in order.
+  size_t m_reordered = 0;
+  // Actions that arrived after a later action had already been appended,
+  // and were dropped.
+  size_t m_late = 0;
+  // Actions appended before their window was over, because the buffer was
+  // full.
+  size_t m_overflowed = 0;
+};
+
+/**
+ * Puts actions that arrive slightly out of order (like inputs of both
+ * players coming from different threads, or hooks that fire late) back in
+ * order before they're added to an action atom.
+ *
+ * An action is held back until an action more than `window` frames after it
+ * arrives, so anything arriving at most `window` frames behind the newest
+ * action is still put in order; actions on the same frame keep the order
+ * they arrived in. At most `capacity` actions are held back, and nothing is
+ * allocated after construction (other than what the atom allocates).
+ *
+ * Call [`flush`] once all actions are in.
+ */
+template <IsInstrumentation Instr = NoInstrumentation>
+class BasicReorderBuffer {
+public:
+  using Atom = BasicActionAtom<Instr>;
+
+private:
+  struct Entry {
+    Action m_action;
+    // Keeps actions on the same frame in arrival order
+    uint64_t m_sequence;
+  };
+
+  Atom &m_atom;
+  uint64_t m_window;
+  size_t m_capacity;
+
+  // A min-heap of held back actions, by frame and arrival
+  std::vector<Entry> m_heap;
+  uint64_t m_sequence = 0;
+  uint64_t m_newestFrame = 0;
+  ReorderStats m_stats;
+
+  static bool after(const Entry &lhs, const Entry &rhs) {
+    if (lhs.m_action.m_frame != rhs.m_action.m_frame) {
+      return lhs.m_action.m_frame > rhs.m_action.m_frame;
+    }
+
+    return lhs.m_sequence > rhs.m_sequence;
+  }
+
+  uint64_t lastFrame() const {
+    return m_atom.m_actions.empty() ? 0 : m_atom.m_actions.back().m_frame;
+  }
+
+  void emit() {
+    std::pop_heap(m_heap.begin(), m_heap.end(), after);
+
+    Action action = m_heap.back().m_action;
+    m_heap.pop_back();
+
+    action.recalculateDelta(lastFrame());
+    m_atom.m_actions.push_back(action);
+    m_stats.m_emitted++;
+  }
+
+public:
+  /**
+   * Create a buffer in front of given atom. Actions already in the atom stay
+   * where they are; new ones can't go before them.
+   */
+  explicit BasicReorderBuffer(Atom &atom, uint64_t window = 16,
+                              size_t capacity = 4096)
+      : m_atom(atom), m_window(window),
+        m_capacity(std::max<size_t>(capacity, 1)), m_newestFrame(lastFrame()) {
+    m_heap.reserve(m_capacity + 1);
+  }
+
+  /**
+   * Add an action. Only its frame is used; its delta is recalculated once
+   * it's appended to the atom.
+   *
+   * Fails (and drops the action) if an action after it was already appended.
+   */
+  Result<> push(const Action &action) {
+    if (action.m_frame < lastFrame()) {
+      m_stats.m_late++;
+      return std::unexpected("action arrived too late to be put in order");
+    }
+
+    if (action.m_frame < m_newestFrame) {
+      m_stats.m_reordered++;
+    }
+
+    m_newestFrame = std::max(m_newestFrame, action.m_frame);
+
+    m_heap.push_back(Entry{action, m_sequence++});
+    std::push_heap(m_heap.begin(), m_heap.end(), after);
+
+    if (m_heap.size() > m_capacity) {
+      emit();
+      m_stats.m_overflowed++;
+    }
+
+    // Nothing can arrive before these anymore without being late
+    while (!m_heap.empty() &&
+           m_newestFrame - m_heap.front().m_action.m_frame > m_window) {
+      emit();
+    }
+
+    return {};
+  }
+
+  /**
+   * Add a player action.
+   * This only supports Jump, Left and Right actions.
+   */
+  Result<> addAction(uint64_t frame, Action::ActionType actionType,
+                     bool holding, bool p2) {
+    using At = Action::ActionType;
+    if (!util::inRange<At, At::Jump, At::Right>(actionType)) {
+      return std::unexpected("invalid action type provided to addAction "
+                             "function; use other overloads");
+    }
+
+    return push(Action(frame, 0, actionType, holding, p2));
+  }
+
+  /**
+   * Add a death action.
+   * This only supports Restart, RestartFull and Death actions.
+   */
+  Result<> addAction(uint64_t frame, Action::ActionType actionType,
+                     uint64_t seed) {
+    using At = Action::ActionType;
+    if (!util::inRange<At, At::Restart, At::Death>(actionType)) {
+      return std::unexpected("invalid action type provided to addAction "
+                             "function; use other overloads");
+    }
+
+    return push(Action(frame, 0, actionType, seed));
+  }
+
+  /**
+   * Add a TPS action.
+   */
+  Result<> addAction(uint64_t frame, double tps) {
+    if (tps <= 0.0) {
+      return std::unexpected(
+          "invalid tps provided to addAction function; must be positive");
+    }
+
+    return push(Action(frame, 0, tps));
+  }
+
+  /**
+   * Append every action that's still held back.
+   */
+  void flush() {
+    while (!m_heap.empty()) {
+      emit();
+    }
+  }
+
+  /**
+   * How many actions are held back.
+   */
+  size_t pending() const { return m_heap.size(); }
+
+  const ReorderStats &stats() const { return m_stats; }
+};
+
+using ReorderBuffer = BasicReorderBuffer<>;
+
+} // namespace v3
+
+SLC_NS_END
+
+#endif
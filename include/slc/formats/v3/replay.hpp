@@ -4,6 +4,7 @@
 #include "slc/formats/v3/atom.hpp"
 #include "slc/formats/v3/builtin.hpp"
 #include "slc/formats/v3/error.hpp"
+#include "slc/formats/v3/marker.hpp"
 #include "slc/formats/v3/metadata.hpp"
 
 #pragma GCC diagnostic push
@@ -22,7 +23,15 @@ SLC_NS_BEGIN
 
 namespace v3 {
 
-using DefaultRegistry = AtomRegistry<NullAtom, ActionAtom>;
+using DefaultRegistry = AtomRegistry<NullAtom, ActionAtom, MarkerAtom>;
+
+/**
+ * The default registry, with actions reported to an instrumentation policy.
+ * Use it as `Replay<InstrumentedRegistry<MyPolicy>>`.
+ */
+template <IsInstrumentation Instr>
+using InstrumentedRegistry =
+    AtomRegistry<NullAtom, BasicActionAtom<Instr>, MarkerAtom>;
 
 template <typename Registry = DefaultRegistry> class Replay {
 private:
@@ -32,6 +41,13 @@ public:
   Metadata m_meta;
   Registry m_atoms;
 
+  /**
+   * Write a CRC32C checksum of the metadata and of every atom.
+   * Checksums are always verified on read; this is set when reading a replay
+   * that has them.
+   */
+  bool m_checksums = false;
+
 private:
 public:
   static constexpr uint64_t HEADER_SIZE = 8;
@@ -42,7 +58,7 @@ public:
 
   static constexpr uint16_t META_SIZE = sizeof(Metadata);
 
-  static Result<Self> read(std::istream &in) {
+  static Result<Self> read(std::istream &in, const ReadOptions &options = {}) {
     std::array<uint8_t, HEADER_SIZE> headerBuf;
     in.read(reinterpret_cast<char *>(headerBuf.data()), HEADER_SIZE);
 
@@ -58,13 +74,18 @@ public:
           "invalid metadata size, likely outdated or malformed replay");
     }
 
-    // this is assuming metadata is actually correct in the replay
-    // checksums will validate metadata but it could still be garbage
-    // a way to prevent it would be to checksum the metadata itself
-    // but that kinda sucks
     replay.m_meta = util::binRead<Metadata>(in);
 
-    TRY(replay.m_atoms.readAll(in));
+    // Without a checksum, this is assuming metadata is actually correct
+    if (replay.m_meta.m_checksum != 0) {
+      if (replay.m_meta.computeChecksum() != replay.m_meta.m_checksum) {
+        return std::unexpected("metadata checksum mismatch");
+      }
+
+      replay.m_checksums = true;
+    }
+
+    TRY(replay.m_atoms.readAll(in, options));
 
     uint8_t footerBuf = util::binRead<uint8_t>(in);
     if (FOOTER != footerBuf) {
@@ -75,17 +96,33 @@ public:
   }
 
   Result<> write(std::ostream &out) {
-    out.write(reinterpret_cast<const char *>(HEADER.data()), HEADER_SIZE);
+    Metadata meta = m_meta;
+    meta.m_checksum = m_checksums ? meta.computeChecksum() : 0;
 
-    util::binWrite(out, META_SIZE);
-    util::binWrite(out, m_meta);
+    writeHeader(out, meta);
 
-    m_atoms.writeAll(out);
+    TRY(m_atoms.writeAll(out, m_checksums));
 
-    util::binWrite(out, FOOTER);
+    writeFooter(out);
 
     return {};
   }
+
+  /**
+   * Write the container header and metadata.
+   * Use this along with [`writeFooter`] when writing atoms by hand.
+   */
+  static void writeHeader(std::ostream &out, const Metadata &meta) {
+    out.write(reinterpret_cast<const char *>(HEADER.data()), HEADER_SIZE);
+
+    util::binWrite(out, META_SIZE);
+    util::binWrite(out, meta);
+  }
+
+  /**
+   * Write the container footer.
+   */
+  static void writeFooter(std::ostream &out) { util::binWrite(out, FOOTER); }
 };
 
 } // namespace v3
@@ -0,0 +1,190 @@
+#ifndef _SLC_V3_REPORT_HPP
+#define _SLC_V3_REPORT_HPP
+
+#include "slc/formats/v3/section.hpp"
+#include "slc/util.hpp"
+
+#include <array>
+
+SLC_NS_BEGIN
+
+namespace v3 {
+
+/**
+ * A breakdown of how actions were encoded, and where the bytes went.
+ *
+ * Collecting one only costs a few additions per section. Reports can be
+ * summed up with `+=` to get a breakdown over many atoms or replays.
+ */
+struct EncodingReport {
+  // Sections written, by identifier and by delta size (1, 2, 4 or 8 bytes).
+  std::array<std::array<size_t, 4>, 4> m_sections{};
+
+  // Actions that were encoded.
+  size_t m_actions = 0;
+  // Swift pairs (a hold and a release on the same frame) stored as one input.
+  size_t m_swiftPairs = 0;
+  // Player inputs after swift pairs are merged, and how many of those are
+  // covered by Repeat and Progression sections.
+  size_t m_playerInputs = 0;
+  size_t m_repeatedInputs = 0;
+  size_t m_progressionInputs = 0;
+  // Back-references written (they're counted as special sections too), and
+  // the actions they copy.
+  size_t m_backReferences = 0;
+  size_t m_referencedActions = 0;
+
+  // Bytes spent on atom and section headers.
+  size_t m_headerBytes = 0;
+  // Bytes spent on player input states.
+  size_t m_payloadBytes = 0;
+  // Bytes spent on special sections (deltas, seeds and TPS), minus headers.
+  size_t m_specialBytes = 0;
+  // Bytes the sections took up after entropy coding, if they were.
+  size_t m_compressedBytes = 0;
+
+  /**
+   * Record a written section.
+   */
+  void add(const Section &section) {
+    if (section.m_markedForRemoval) {
+      return;
+    }
+
+    const size_t bytes = section.writtenSize();
+
+    m_sections[static_cast<size_t>(section.m_id)][section.m_deltaSize]++;
+    m_headerBytes += sizeof(uint16_t);
+
+    if (section.isBackReference()) {
+      m_backReferences++;
+      m_referencedActions += section.actionCount();
+      m_payloadBytes += bytes - sizeof(uint16_t);
+      return;
+    }
+
+    if (section.isSpecial()) {
+      m_specialBytes += bytes - sizeof(uint16_t);
+      return;
+    }
+
+    size_t repeats = 1;
+    if (section.m_id == Section::Identifier::Repeat) {
+      repeats = section.getRepeatCount();
+    } else if (section.m_id == Section::Identifier::Progression) {
+      repeats = section.getProgressionLength();
+      m_progressionInputs += repeats;
+    }
+
+    size_t swifts = 0;
+    for (const auto &input : section.m_playerInputs) {
+      swifts += input.m_button == PlayerInput::Button::Swift;
+    }
+
+    m_swiftPairs += swifts * repeats;
+    m_playerInputs += section.m_playerInputs.size() * repeats;
+    if (section.m_id == Section::Identifier::Repeat) {
+      m_repeatedInputs += section.m_playerInputs.size() * repeats;
+    }
+
+    m_payloadBytes += bytes - sizeof(uint16_t);
+  }
+
+  /**
+   * How many sections with an identifier were written.
+   */
+  size_t sections(Section::Identifier id) const {
+    size_t count = 0;
+    for (size_t n : m_sections[static_cast<size_t>(id)]) {
+      count += n;
+    }
+
+    return count;
+  }
+
+  size_t totalBytes() const {
+    return m_headerBytes + m_payloadBytes + m_specialBytes;
+  }
+
+  /**
+   * Bytes actually written, which is less than [`totalBytes`] for compressed
+   * atoms. Section headers are compressed along with the sections.
+   */
+  size_t storedBytes() const {
+    if (m_compressedBytes == 0) {
+      return totalBytes();
+    }
+
+    const size_t sectionHeaders = (sections(Section::Identifier::Input) +
+                                   sections(Section::Identifier::Repeat) +
+                                   sections(Section::Identifier::Special) +
+                                   sections(Section::Identifier::Progression)) *
+                                  sizeof(uint16_t);
+    return m_headerBytes - sectionHeaders + m_compressedBytes;
+  }
+
+  /**
+   * The share of player inputs covered by Repeat sections, from 0 to 1.
+   */
+  double repeatCoverage() const {
+    return m_playerInputs == 0 ? 0.0
+                               : static_cast<double>(m_repeatedInputs) /
+                                     static_cast<double>(m_playerInputs);
+  }
+
+  /**
+   * The share of player inputs covered by Progression sections, from 0 to 1.
+   */
+  double progressionCoverage() const {
+    return m_playerInputs == 0 ? 0.0
+                               : static_cast<double>(m_progressionInputs) /
+                                     static_cast<double>(m_playerInputs);
+  }
+
+  /**
+   * The share of actions copied by back-references, from 0 to 1.
+   */
+  double referenceCoverage() const {
+    return m_actions == 0 ? 0.0
+                          : static_cast<double>(m_referencedActions) /
+                                static_cast<double>(m_actions);
+  }
+
+  /**
+   * How many player inputs a Repeat section covers on average.
+   */
+  double averageRunLength() const {
+    const size_t repeats = sections(Section::Identifier::Repeat);
+    return repeats == 0 ? 0.0
+                        : static_cast<double>(m_repeatedInputs) /
+                              static_cast<double>(repeats);
+  }
+
+  EncodingReport &operator+=(const EncodingReport &other) {
+    for (size_t id = 0; id < m_sections.size(); id++) {
+      for (size_t size = 0; size < m_sections[id].size(); size++) {
+        m_sections[id][size] += other.m_sections[id][size];
+      }
+    }
+
+    m_actions += other.m_actions;
+    m_swiftPairs += other.m_swiftPairs;
+    m_playerInputs += other.m_playerInputs;
+    m_repeatedInputs += other.m_repeatedInputs;
+    m_progressionInputs += other.m_progressionInputs;
+    m_backReferences += other.m_backReferences;
+    m_referencedActions += other.m_referencedActions;
+    m_headerBytes += other.m_headerBytes;
+    m_payloadBytes += other.m_payloadBytes;
+    m_specialBytes += other.m_specialBytes;
+    m_compressedBytes += other.m_compressedBytes;
+
+    return *this;
+  }
+};
+
+} // namespace v3
+
+SLC_NS_END
+
+#endif
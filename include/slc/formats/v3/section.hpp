@@ -5,7 +5,11 @@
 #include "slc/formats/v3/error.hpp"
 #include "slc/util.hpp"
 
+#include <algorithm>
+#include <bit>
 #include <cassert>
+#include <cstdint>
+#include <span>
 #include <vector>
 
 SLC_NS_BEGIN
@@ -72,6 +76,251 @@ public:
   }
 };
 
+/**
+ * Section types the encoder may use beyond the ones every reader knows.
+ *
+ * These are opt-in, since older readers can't decode them. Action atoms
+ * encoded with them carry the atom version from [`version`], so those
+ * readers skip such atoms instead of failing on them.
+ */
+struct EncodingOptions {
+  // Encode runs of identical inputs (or ones alternating between hold and
+  // release) with a constant delta as Progression sections.
+  bool m_progressions = false;
+  // Encode inputs that were already encoded earlier on (like the same part
+  // of a level played again) as back-references to them.
+  bool m_backReferences = false;
+
+  // The newest encoding version that can be read. Every version can use the
+  // section types of the versions before it.
+  static constexpr uint8_t LATEST_VERSION = 2;
+
+  /**
+   * The encoding version sections encoded with these options need.
+   */
+  constexpr uint8_t version() const {
+    return m_backReferences ? 2 : m_progressions ? 1 : 0;
+  }
+
+  /**
+   * The options an atom of encoding version `version` may have been encoded
+   * with.
+   */
+  static constexpr EncodingOptions forVersion(uint8_t version) {
+    return {.m_progressions = version >= 1, .m_backReferences = version >= 2};
+  }
+};
+
+/**
+ * Finds earlier copies of upcoming actions, for back-references.
+ *
+ * Works like an LZ77 match finder: every action is hashed together with the
+ * few after it into a hash chain, so finding the longest earlier copy only
+ * walks a bounded number of candidates. Actions are seen as soon as they're
+ * handed to the encoder, but only become candidates once they're encoded.
+ */
+class BackReferenceMatcher {
+public:
+  // How far back (in actions) a back-reference may point. Decoders keep at
+  // least this many decoded actions around.
+  static constexpr uint64_t MAX_DISTANCE = 1 << 16;
+  // How many actions a single back-reference may copy.
+  static constexpr uint64_t MAX_LENGTH = 1 << 8;
+
+  struct Match {
+    uint64_t m_distance = 0;
+    size_t m_length = 0;
+  };
+
+private:
+  static constexpr size_t HASH_LENGTH = 8;
+  static constexpr size_t HASH_BITS = 15;
+  static constexpr size_t MAX_CANDIDATES = 32;
+  // Runs repeating this often are left to Repeat and Progression sections
+  static constexpr uint64_t MAX_CLUSTER_SIZE = 64;
+
+  // Everything that's decoded for an action
+  struct Key {
+    uint64_t m_delta;
+    // The seed or TPS of special actions
+    uint64_t m_value;
+    // Type, holding, player 2, and whether the action is the release of a
+    // swift input
+    uint8_t m_flags;
+
+    bool operator==(const Key &) const = default;
+
+    bool release() const { return m_flags & 1; }
+  };
+
+  // Keys of the actions from `m_first` on
+  std::vector<Key> m_keys;
+  uint64_t m_first = 0;
+  // The first action that hasn't been encoded, and the one before it
+  uint64_t m_next = 0;
+  Action m_last{0, 0, Action::ActionType::Bugpoint};
+  // The action the span given to `see` starts at
+  uint64_t m_base = 0;
+
+  // Latest position (plus one) of every hash, and the position (plus one)
+  // before every position with the same hash
+  std::vector<uint64_t> m_head;
+  std::vector<uint64_t> m_chain;
+  uint64_t m_inserted = 0;
+
+  // Mirrors how the encoder pairs up swift inputs
+  static bool release(const Action &previous, const Action &action) {
+    return action.m_type == Action::ActionType::Jump && previous.isPlayer() &&
+           previous.getMinimumSize() == action.getMinimumSize() &&
+           action.delta() == 0 && !action.m_holding && previous.m_holding &&
+           previous.m_player2 == action.m_player2 &&
+           previous.m_type == action.m_type;
+  }
+
+  static Key key(const Action &previous, const Action &action) {
+    using A = Action::ActionType;
+
+    Key key{.m_delta = action.delta(),
+            .m_value = 0,
+            .m_flags = static_cast<uint8_t>(
+                static_cast<uint8_t>(action.m_type) << 3 |
+                action.m_holding << 2 | action.m_player2 << 1 |
+                release(previous, action))};
+
+    if (action.m_type == A::TPS) {
+      key.m_value = std::bit_cast<uint64_t>(action.m_tps);
+    } else if (!action.isPlayer() && action.m_type != A::Bugpoint) {
+      key.m_value = action.m_seed;
+    }
+
+    return key;
+  }
+
+  const Key &at(uint64_t position) const { return m_keys[position - m_first]; }
+
+  size_t hash(uint64_t position) const {
+    uint64_t h = 0;
+    for (size_t i = 0; i < HASH_LENGTH; i++) {
+      const Key &k = at(position + i);
+      h = (h ^ k.m_delta) * 0x9E3779B97F4A7C15ull;
+      h = (h ^ k.m_value ^ k.m_flags) * 0x9E3779B97F4A7C15ull;
+    }
+
+    return h >> (64 - HASH_BITS);
+  }
+
+public:
+  BackReferenceMatcher() : m_head(1 << HASH_BITS), m_chain(MAX_DISTANCE) {}
+
+  /**
+   * Look at the actions about to be encoded, starting with the first one
+   * that hasn't been. Actions seen before are only looked at again.
+   */
+  void see(std::span<const Action> actions) {
+    m_base = m_next;
+
+    for (size_t i = m_first + m_keys.size() - m_next; i < actions.size();
+         i++) {
+      m_keys.push_back(key(i == 0 ? m_last : actions[i - 1], actions[i]));
+    }
+  }
+
+  /**
+   * Mark the actions before `actions[count]` as encoded, where `actions` is
+   * what was given to [`see`].
+   */
+  void consume(std::span<const Action> actions, size_t count) {
+    if (count == 0) {
+      return;
+    }
+
+    m_next = m_base + count;
+    m_last = actions[count - 1];
+
+    const uint64_t end = m_first + m_keys.size();
+    for (; m_inserted < m_next && m_inserted + HASH_LENGTH <= end;
+         m_inserted++) {
+      const size_t h = hash(m_inserted);
+      m_chain[m_inserted % MAX_DISTANCE] = m_head[h];
+      m_head[h] = m_inserted + 1;
+    }
+
+    // Actions that are too far back to be referenced are dropped every now
+    // and then
+    if (m_inserted - m_first > 2 * MAX_DISTANCE) {
+      const size_t drop = m_inserted - m_first - MAX_DISTANCE;
+      m_keys.erase(m_keys.begin(), m_keys.begin() + drop);
+      m_first += drop;
+    }
+  }
+
+  /**
+   * Find the longest earlier copy of the actions from `actions[i]` on, where
+   * `actions` is what was given to [`see`]. The copy may overlap them.
+   *
+   * Nothing is found for actions that Repeat and Progression sections can
+   * cover just as well, and copies never split a swift input.
+   */
+  Match find(size_t i) const {
+    const uint64_t position = m_base + i;
+    const uint64_t end = m_first + m_keys.size();
+
+    Match best;
+    if (end - position < HASH_LENGTH || at(position).release()) {
+      return best;
+    }
+
+    const size_t limit = std::min<uint64_t>(MAX_LENGTH, end - position);
+    bool periodic = false;
+
+    uint64_t candidate = m_head[hash(position)];
+    for (size_t n = 0; candidate != 0 && n < MAX_CANDIDATES; n++) {
+      const uint64_t from = candidate - 1;
+      const uint64_t distance = position - from;
+      if (from < m_first || distance > MAX_DISTANCE) {
+        break;
+      }
+
+      size_t length = 0;
+      while (length < limit && at(from + length) == at(position + length)) {
+        length++;
+      }
+
+      // A copy ending on the hold of a swift input would leave its release
+      // behind
+      while (length > 0 &&
+             ((position + length < end && at(position + length).release()) ||
+              at(from + length).release())) {
+        length--;
+      }
+
+      if (length > best.m_length) {
+        best = {distance, length};
+        periodic = false;
+      }
+
+      if (length == best.m_length && distance <= MAX_CLUSTER_SIZE &&
+          std::has_single_bit(distance)) {
+        periodic = true;
+      }
+
+      if (length == limit) {
+        break;
+      }
+
+      // Older positions share the slot once they're out of the window
+      const uint64_t next = m_chain[from % MAX_DISTANCE];
+      if (next >= candidate) {
+        break;
+      }
+
+      candidate = next;
+    }
+
+    return periodic ? Match{} : best;
+  }
+};
+
 class Section {
 public:
   enum class Identifier : uint8_t {
@@ -91,8 +340,20 @@ public:
      * 10 XXXX XX
      * -- ---- --
      * ID Type Size
+     *
+     * Back-references use the 8 bits after Size for their length (in actions,
+     * minus one), and Size for the size of the distance that follows.
      */
     Special,
+    /**
+     * 11 XX   X         XXXXXXXXXXX
+     * -- --   -         -----------
+     * ID Size Alternate Count - 1
+     *
+     * One input, repeated `count` times. If Alternate is set, every other
+     * repetition flips between hold and release. Needs encoding version 1.
+     */
+    Progression,
   };
 
   enum class SpecialType : uint8_t {
@@ -101,6 +362,11 @@ public:
     Death,
     TPS,
     Bugpoint,
+    /**
+     * Copies actions that were already decoded, starting `distance` actions
+     * back. Needs encoding version 2.
+     */
+    BackReference,
   };
 
 private:
@@ -108,6 +374,13 @@ private:
   uint16_t m_countExp;
   uint16_t m_repeatsExp;
 
+  // Progression; for back-references, the length is in actions
+  uint16_t m_length = 0;
+  bool m_alternating = false;
+
+  // Back-reference
+  uint64_t m_distance = 0;
+
   // Special
   SpecialType m_specialType;
   uint64_t m_seed;
@@ -128,8 +401,13 @@ public:
     return 1ull << (uint64_t)m_deltaSize;
   }
   uint64_t getInputCount() const { return 1ull << (uint64_t)m_countExp; }
-  uint64_t getRepeatCount() { return 1ull << (uint64_t)m_repeatsExp; }
+  uint64_t getRepeatCount() const { return 1ull << (uint64_t)m_repeatsExp; }
+  uint64_t getProgressionLength() const { return m_length; }
   inline bool isSpecial() const { return m_id == Identifier::Special; }
+  inline bool isBackReference() const {
+    return isSpecial() && m_specialType == SpecialType::BackReference;
+  }
+  uint64_t getBackReferenceDistance() const { return m_distance; }
 
   void copyFrom(Section &other) {
     assert(!isSpecial());
@@ -138,6 +416,56 @@ public:
                           other.m_playerInputs.end());
   }
 
+  /**
+   * How many bytes the section takes up once written, header included.
+   */
+  size_t writtenSize() const {
+    if (m_markedForRemoval) {
+      return 0;
+    }
+
+    switch (m_id) {
+    case Identifier::Input:
+    case Identifier::Repeat:
+      return sizeof(uint16_t) + m_playerInputs.size() * getRealDeltaSize();
+    case Identifier::Special:
+      return sizeof(uint16_t) + getRealDeltaSize() +
+             (m_specialType == SpecialType::Bugpoint ||
+                      m_specialType == SpecialType::BackReference
+                  ? 0
+                  : sizeof(uint64_t));
+    case Identifier::Progression:
+      return sizeof(uint16_t) + getRealDeltaSize();
+    }
+
+    return 0; // unreachable
+  }
+
+  /**
+   * How many actions the section decodes to.
+   */
+  uint64_t actionCount() const {
+    if (m_markedForRemoval) {
+      return 0;
+    }
+
+    if (isSpecial()) {
+      return isBackReference() ? m_length : 1;
+    }
+
+    // Swifts take up two actions
+    const uint64_t actions =
+        m_playerInputs.size() +
+        std::ranges::count(m_playerInputs, PlayerInput::Button::Swift,
+                           &PlayerInput::m_button);
+
+    if (m_id == Identifier::Progression) {
+      return actions * m_length;
+    }
+
+    return m_id == Identifier::Repeat ? actions * getRepeatCount() : actions;
+  }
+
   size_t totalSize() {
     return newSizeAssumingDeltaSize(getInputCount(), getRealDeltaSize());
   }
@@ -152,6 +480,9 @@ public:
     case Identifier::Special: {
       return 1 + 8 + size;
     }
+    case Identifier::Progression: {
+      return 2 + size;
+    }
     }
 
     return 0; // unreachable
@@ -167,12 +498,6 @@ public:
     for (size_t i = start; i < end; i++) {
       auto &action = actions[i];
       if (action.m_holding || !action.swift()) {
-#ifdef SLC_INSPECT
-        std::println("Processing {} button {} delta {}, marked swift {}", i,
-                     static_cast<int>(action.m_type), action.delta(),
-                     action.swift());
-#endif
-
         s.m_playerInputs.push_back(PlayerInput::fromAction(actions[i]));
         count++;
       }
@@ -180,12 +505,6 @@ public:
 
     s.m_countExp = util::exponentOfTwo(count);
 
-#ifdef SLC_INSPECT
-    std::println(
-        "Preparing Input section from {} to {}, with count {}, swifts {}",
-        start, end, count, swifts);
-#endif
-
     return s;
   }
 
@@ -238,6 +557,23 @@ public:
     return s;
   }
 
+  static Section backReference(const BackReferenceMatcher::Match &match) {
+    assert(match.m_length > 0 &&
+           match.m_length <= BackReferenceMatcher::MAX_LENGTH);
+
+    Section s;
+
+    s.m_id = Identifier::Special;
+    s.m_specialType = SpecialType::BackReference;
+    s.m_distance = match.m_distance;
+    s.m_length = static_cast<uint16_t>(match.m_length);
+    s.m_deltaSize = match.m_distance < (1 << 8)    ? 0
+                    : match.m_distance < (1 << 16) ? 1
+                                                   : 2;
+
+    return s;
+  }
+
   static void distributeInputsToSections(std::vector<Section> &sections,
                                          std::vector<PlayerInput> &inputs,
                                          uint16_t deltaSize) {
@@ -258,13 +594,45 @@ public:
     inputs.clear();
   }
 
-  std::vector<Section> runLengthEncode() {
+  /**
+   * How many inputs from `idx` on could make up a Progression section, and
+   * whether they alternate between hold and release.
+   */
+  size_t progressionLength(size_t idx, bool &alternating) const {
+    constexpr size_t MAX_PROGRESSION_LENGTH = 1 << 11;
+
+    const size_t N = m_playerInputs.size();
+    const PlayerInput &base = m_playerInputs[idx];
+
+    alternating = idx + 1 < N && base.m_button != PlayerInput::Button::Swift &&
+                  m_playerInputs[idx + 1].m_holding != base.m_holding;
+
+    size_t length = 1;
+    while (idx + length < N && length < MAX_PROGRESSION_LENGTH) {
+      const PlayerInput &input = m_playerInputs[idx + length];
+      const bool holding = base.m_holding != (alternating && (length & 1));
+
+      if (input.m_delta != base.m_delta || input.m_button != base.m_button ||
+          input.m_player2 != base.m_player2 || input.m_holding != holding) {
+        break;
+      }
+
+      length++;
+    }
+
+    return length;
+  }
+
+  std::vector<Section> runLengthEncode(const EncodingOptions &options = {}) {
     assert(m_id == Identifier::Input);
 
     std::vector<Section> newSections;
     std::vector<PlayerInput> freeInputs;
 
     constexpr size_t MAX_CLUSTER_SIZE = 64;
+    // Shorter progressions are cheaper to store as they are, since they
+    // break up the input sections around them
+    constexpr size_t MIN_PROGRESSION_LENGTH = 6;
 
     size_t idx = 0;
     const size_t N = m_playerInputs.size();
@@ -285,7 +653,8 @@ public:
           const size_t start = idx + offset * cluster;
           const size_t end = idx + offset * (cluster + 1);
 
-          if (end >= N) {
+          // The cluster at `start` has to fit as well
+          if (end >= N || start + cluster > N) {
             break;
           }
 
@@ -318,7 +687,25 @@ public:
         }
       }
 
-      if (foundAnyRepetitions) {
+      bool alternating = false;
+      const size_t progression =
+          options.m_progressions ? progressionLength(idx, alternating) : 0;
+
+      if (progression >= MIN_PROGRESSION_LENGTH &&
+          (int64_t)progression - 1 > bestClusterScore) {
+        distributeInputsToSections(newSections, freeInputs,
+                                   m_deltaSize); // flush buffer
+
+        Section run;
+        run.m_id = Identifier::Progression;
+        run.m_deltaSize = m_deltaSize;
+        run.m_length = static_cast<uint16_t>(progression);
+        run.m_alternating = alternating;
+        run.m_playerInputs = {m_playerInputs[idx]};
+        newSections.push_back(std::move(run));
+
+        idx += progression;
+      } else if (foundAnyRepetitions) {
         distributeInputsToSections(newSections, freeInputs,
                                    m_deltaSize); // flush buffer
 
@@ -348,7 +735,15 @@ public:
     return newSections;
   }
 
-  static void read(std::istream &s, std::vector<Action> &actions) {
+  /**
+   * Read a section, appending its actions to `actions`.
+   *
+   * Fails without expanding the section if that would take `actions` past
+   * `limit` actions; repeat sections can otherwise expand a few bytes into
+   * billions of actions.
+   */
+  static Result<> read(std::istream &s, std::vector<Action> &actions,
+                       size_t limit = SIZE_MAX) {
     uint16_t initialHeader = util::binRead<uint16_t>(s);
 
     Identifier id = static_cast<Identifier>(initialHeader >> 14);
@@ -359,6 +754,10 @@ public:
 
       uint64_t byteSize = 1ull << (uint64_t)deltaSize;
       uint64_t length = 1ull << (uint64_t)countExp;
+      if (length > limit - std::min(limit, actions.size())) {
+        return std::unexpected("section decodes past the action count");
+      }
+
       for (uint64_t i = 0; i < length; i++) {
         uint64_t state = 0;
         s.read(reinterpret_cast<char *>(&state), byteSize);
@@ -385,6 +784,11 @@ public:
         }
       }
 
+      // Swifts take up two actions
+      if (actions.size() > limit) {
+        return std::unexpected("section decodes past the action count");
+      }
+
       break;
     };
     case Identifier::Repeat: {
@@ -411,6 +815,14 @@ public:
         inputs.push_back(p);
       }
 
+      // Swifts take up two actions
+      const uint64_t swifts = std::ranges::count(
+          inputs, PlayerInput::Button::Swift, &PlayerInput::m_button);
+      if ((length + swifts) * repeats >
+          limit - std::min(limit, actions.size())) {
+        return std::unexpected("repeat section expands past the action count");
+      }
+
       for (uint64_t i = 0; i < repeats; i++) {
         for (size_t j = 0; j < inputs.size(); j++) {
           auto &p = inputs[j];
@@ -439,11 +851,83 @@ public:
 
       break;
     }
+    case Identifier::Progression: {
+      uint16_t deltaSize = (initialHeader >> 12) & 0b11;
+      const bool alternating = (initialHeader >> 11) & 0b1;
+      const uint64_t length = (initialHeader & 0x7FF) + 1;
+
+      uint64_t state = 0;
+      s.read(reinterpret_cast<char *>(&state), 1ull << deltaSize);
+
+      const PlayerInput p = PlayerInput::fromState(0, state);
+      const bool swift = p.m_button == PlayerInput::Button::Swift;
+
+      if (length * (swift ? 2 : 1) > limit - std::min(limit, actions.size())) {
+        return std::unexpected("section decodes past the action count");
+      }
+
+      uint64_t frame = actions.empty() ? 0 : actions.back().m_frame;
+
+      if (swift) {
+        for (uint64_t i = 0; i < length; i++) {
+          actions.push_back(Action(frame, p.m_delta, Action::ActionType::Jump,
+                                   true, p.m_player2));
+          actions.back().m_swift = true;
+          frame += p.m_delta;
+          actions.push_back(
+              Action(frame, 0, Action::ActionType::Jump, false, p.m_player2));
+          actions.back().m_swift = true;
+        }
+      } else {
+        const auto type = static_cast<Action::ActionType>(p.m_button);
+        for (uint64_t i = 0; i < length; i++) {
+          const bool holding = p.m_holding != (alternating && (i & 1));
+          actions.push_back(
+              Action(frame, p.m_delta, type, holding, p.m_player2));
+          frame += p.m_delta;
+        }
+      }
+
+      break;
+    }
     case Identifier::Special: {
       uint16_t deltaSize = (initialHeader >> 8) & 0b11;
       SpecialType specialType =
           static_cast<SpecialType>((initialHeader >> 10) & 0b1111);
 
+      if (specialType == SpecialType::BackReference) {
+        const uint64_t length = (initialHeader & 0xFF) + 1;
+
+        uint64_t distance = 0;
+        s.read(reinterpret_cast<char *>(&distance), 1 << deltaSize);
+
+        if (length > limit - std::min(limit, actions.size())) {
+          return std::unexpected("section decodes past the action count");
+        }
+
+        if (distance == 0 || distance > actions.size() ||
+            distance > BackReferenceMatcher::MAX_DISTANCE) {
+          return std::unexpected(
+              "back-reference points outside of the decoded actions");
+        }
+
+        // The copy may overlap what it's copying, so it goes one at a time
+        const size_t from = actions.size() - distance;
+        uint64_t frame = actions.back().m_frame;
+        for (uint64_t i = 0; i < length; i++) {
+          Action action = actions[from + i];
+          action.m_frame = frame + action.delta();
+          frame = action.m_frame;
+          actions.push_back(action);
+        }
+
+        break;
+      }
+
+      if (actions.size() >= limit) {
+        return std::unexpected("section decodes past the action count");
+      }
+
       uint64_t frameDelta = 0;
       s.read(reinterpret_cast<char *>(&frameDelta), 1 << deltaSize);
 
@@ -467,16 +951,27 @@ public:
             currentFrame, frameDelta,
             static_cast<Action::ActionType>(static_cast<int>(specialType) + 4),
             seed));
+        break;
       }
       case SpecialType::Bugpoint: {
         actions.push_back(
             Action(currentFrame, frameDelta, Action::ActionType::Bugpoint));
+        break;
       }
+      default:
+        return std::unexpected("unknown special section type");
       }
 
       break;
     };
     }
+
+    // A section cut off by the end of the stream decodes garbage
+    if (s.fail()) {
+      return std::unexpected("unexpected end of stream while reading section");
+    }
+
+    return {};
   }
 
   void write(std::ostream &s) const {
@@ -521,7 +1016,34 @@ public:
 
       break;
     }
+    case Identifier::Progression: {
+      uint16_t header = static_cast<uint16_t>(Identifier::Progression) << 14 |
+                        m_deltaSize << 12 | m_alternating << 11 |
+                        (m_length - 1);
+
+      util::binWrite(s, header);
+
+      uint64_t byteSize = getRealDeltaSize();
+      uint64_t state = m_playerInputs.front().prepareState(byteSize);
+
+      s.write(reinterpret_cast<const char *>(&state), byteSize);
+
+      break;
+    }
     case Identifier::Special: {
+      if (m_specialType == SpecialType::BackReference) {
+        uint16_t header = static_cast<uint16_t>(Identifier::Special) << 14 |
+                          static_cast<uint16_t>(m_specialType) << 10 |
+                          (m_deltaSize << 8) | (m_length - 1);
+
+        util::binWrite(s, header);
+
+        s.write(reinterpret_cast<const char *>(&m_distance),
+                getRealDeltaSize());
+
+        break;
+      }
+
       uint16_t header = static_cast<uint16_t>(Identifier::Special) << 14 |
                         static_cast<uint16_t>(m_specialType) << 10 |
                         (m_deltaSize << 8);
@@ -542,6 +1064,7 @@ public:
         util::binWrite(s, m_tps);
         break;
       case SpecialType::Bugpoint:
+      case SpecialType::BackReference:
         break;
       }
 
@@ -0,0 +1,425 @@
+#ifndef _SLC_V3_VALIDATE_HPP
+#define _SLC_V3_VALIDATE_HPP
+
+#include "slc/formats/v3/atom.hpp"
+#include "slc/formats/v3/checksum.hpp"
+#include "slc/formats/v3/metadata.hpp"
+#include "slc/formats/v3/rans.hpp"
+#include "slc/formats/v3/replay.hpp"
+#include "slc/formats/v3/section.hpp"
+#include "slc/util.hpp"
+
+#include <cstring>
+#include <expected>
+#include <optional>
+#include <span>
+
+SLC_NS_BEGIN
+
+namespace v3 {
+
+/**
+ * Where and why a replay failed validation.
+ */
+struct ValidationError {
+  // Offset of the malformed structure from the start of the replay.
+  size_t m_offset;
+  const char *m_message;
+};
+
+/**
+ * What a valid replay contains.
+ */
+struct ValidationInfo {
+  size_t m_atoms = 0;
+  // Action atoms whose sections were checked.
+  size_t m_actionAtoms = 0;
+  // Actions those atoms decode to.
+  uint64_t m_actions = 0;
+  // Atoms that couldn't be checked beyond their framing: unknown atoms,
+  // atoms with flags this version doesn't read, and compressed action atoms
+  // (whose sections can't be checked without decoding them).
+  size_t m_opaqueAtoms = 0;
+};
+
+namespace detail {
+
+class Validator {
+private:
+  std::span<const uint8_t> m_data;
+
+  template <typename T> T load(size_t offset) const {
+    T value;
+    std::memcpy(&value, m_data.data() + offset, sizeof(T));
+    return value;
+  }
+
+  static std::unexpected<ValidationError> fail(size_t offset,
+                                               const char *message) {
+    return std::unexpected(ValidationError{offset, message});
+  }
+
+  /**
+   * Count the swift inputs in `count` states of `byteSize` bytes each.
+   * The button is in bits 2 and 3 of the first byte of every state.
+   */
+  uint64_t countSwifts(size_t offset, uint64_t count,
+                       uint64_t byteSize) const {
+    uint64_t swifts = 0;
+    const uint8_t *state = m_data.data() + offset;
+    for (uint64_t i = 0; i < count; i++) {
+      swifts += (*state & 0b1100) == 0;
+      state += byteSize;
+    }
+
+    return swifts;
+  }
+
+  /**
+   * Check the sections holding `count` actions that start at `pos`, without
+   * going past `end`, for an atom of encoding version `version`. Returns where
+   * they end.
+   */
+  std::expected<size_t, ValidationError>
+  sections(size_t pos, size_t end, uint64_t count, uint8_t version) const {
+    uint64_t actions = 0;
+
+    while (actions < count) {
+      if (end - pos < sizeof(uint16_t)) {
+        return fail(pos, "sections end before all actions are decoded");
+      }
+
+      const size_t sectionStart = pos;
+      const uint16_t header = load<uint16_t>(pos);
+      pos += sizeof(uint16_t);
+
+      switch (static_cast<Section::Identifier>(header >> 14)) {
+      case Section::Identifier::Input: {
+        if ((header & 0xFF) != 0) {
+          return fail(sectionStart, "reserved bits set in input section");
+        }
+
+        const uint64_t byteSize = 1ull << ((header >> 12) & 0b11);
+        const uint64_t length = 1ull << ((header >> 8) & 0b1111);
+
+        if ((end - pos) / byteSize < length) {
+          return fail(sectionStart, "input section exceeds atom size");
+        }
+
+        actions += length + countSwifts(pos, length, byteSize);
+        pos += length * byteSize;
+        break;
+      }
+      case Section::Identifier::Repeat: {
+        if ((header & 0b111) != 0) {
+          return fail(sectionStart, "reserved bits set in repeat section");
+        }
+
+        const uint64_t byteSize = 1ull << ((header >> 12) & 0b11);
+        const uint64_t length = 1ull << ((header >> 8) & 0b1111);
+        const uint64_t repeats = 1ull << ((header >> 3) & 0b11111);
+
+        if ((end - pos) / byteSize < length) {
+          return fail(sectionStart, "repeat section exceeds atom size");
+        }
+
+        const uint64_t perRepeat = length + countSwifts(pos, length, byteSize);
+        if (perRepeat * repeats > count - actions) {
+          return fail(sectionStart,
+                      "repeat section expands past the action count");
+        }
+
+        actions += perRepeat * repeats;
+        pos += length * byteSize;
+        break;
+      }
+      case Section::Identifier::Special: {
+        const auto type =
+            static_cast<Section::SpecialType>((header >> 10) & 0b1111);
+        if (type == Section::SpecialType::BackReference) {
+          if (version < 2) {
+            return fail(sectionStart, "back-reference in an atom of encoding "
+                                      "version below 2");
+          }
+
+          const size_t size = 1ull << ((header >> 8) & 0b11);
+          if (end - pos < size) {
+            return fail(sectionStart, "back-reference exceeds atom size");
+          }
+
+          uint64_t distance = 0;
+          std::memcpy(&distance, m_data.data() + pos, size);
+          if (distance == 0 || distance > actions ||
+              distance > BackReferenceMatcher::MAX_DISTANCE) {
+            return fail(sectionStart,
+                        "back-reference points outside of the decoded actions");
+          }
+
+          const uint64_t length = (header & 0xFF) + 1;
+          if (length > count - actions) {
+            return fail(sectionStart,
+                        "back-reference copies past the action count");
+          }
+
+          actions += length;
+          pos += size;
+          break;
+        }
+
+        if ((header & 0xFF) != 0) {
+          return fail(sectionStart, "reserved bits set in special section");
+        }
+
+        if (type > Section::SpecialType::BackReference) {
+          return fail(sectionStart, "unknown special section type");
+        }
+
+        const size_t size =
+            (1ull << ((header >> 8) & 0b11)) +
+            (type == Section::SpecialType::Bugpoint ? 0 : sizeof(uint64_t));
+        if (end - pos < size) {
+          return fail(sectionStart, "special section exceeds atom size");
+        }
+
+        if (type == Section::SpecialType::TPS &&
+            !(load<double>(pos + size - sizeof(double)) > 0.0)) {
+          return fail(pos + size - sizeof(double), "non-positive TPS");
+        }
+
+        actions++;
+        pos += size;
+        break;
+      }
+      case Section::Identifier::Progression: {
+        if (version < 1) {
+          return fail(sectionStart,
+                      "progression section in an atom of encoding version 0");
+        }
+
+        const uint64_t byteSize = 1ull << ((header >> 12) & 0b11);
+        const uint64_t length = (header & 0x7FF) + 1;
+
+        if (end - pos < byteSize) {
+          return fail(sectionStart, "progression section exceeds atom size");
+        }
+
+        const uint64_t decoded = length * (1 + countSwifts(pos, 1, byteSize));
+        if (decoded > count - actions) {
+          return fail(sectionStart,
+                      "progression section expands past the action count");
+        }
+
+        actions += decoded;
+        pos += byteSize;
+        break;
+      }
+      }
+
+      if (actions > count) {
+        return fail(sectionStart, "section decodes past the action count");
+      }
+    }
+
+    return pos;
+  }
+
+  /**
+   * Check the sections of a plain action atom payload, which is
+   * `[begin, end)` and starts with the action count.
+   */
+  std::expected<uint64_t, ValidationError>
+  actionSections(size_t begin, size_t end, const AtomFlags &flags) const {
+    if (end - begin < sizeof(uint64_t)) {
+      return fail(begin, "action atom too small for its action count");
+    }
+
+    const uint64_t count = load<uint64_t>(begin);
+    size_t pos = begin + sizeof(uint64_t);
+
+    if (flags.has(AtomFlags::Split)) {
+      if (end - pos < 2 * sizeof(uint64_t)) {
+        return fail(pos, "split action atom too small for its streams");
+      }
+
+      const uint64_t secondCount = load<uint64_t>(pos);
+      const uint64_t firstSize = load<uint64_t>(pos + sizeof(uint64_t));
+      pos += 2 * sizeof(uint64_t);
+
+      if (secondCount > count || firstSize > end - pos) {
+        return fail(pos - 2 * sizeof(uint64_t),
+                    "split action atom streams exceed the atom");
+      }
+
+      const size_t firstEnd = pos + firstSize;
+      if (TRY(sections(pos, firstEnd, count - secondCount, flags.m_version)) !=
+          firstEnd) {
+        return fail(pos, "first stream doesn't fill its size");
+      }
+
+      pos = TRY(sections(firstEnd, end, secondCount, flags.m_version));
+    } else {
+      pos = TRY(sections(pos, end, count, flags.m_version));
+    }
+
+    if (pos != end) {
+      return fail(pos, "trailing bytes after the last section");
+    }
+
+    return count;
+  }
+
+  /**
+   * Check the framing of a compressed action atom payload.
+   */
+  std::optional<ValidationError> compressedActions(size_t begin,
+                                                   size_t end) const {
+    if (end - begin < 2 * sizeof(uint64_t)) {
+      return ValidationError{begin, "compressed action atom too small"};
+    }
+
+    const uint64_t count = load<uint64_t>(begin);
+    const uint64_t rawSize = load<uint64_t>(begin + sizeof(uint64_t));
+
+    constexpr uint64_t MAX_ACTION_BYTES =
+        sizeof(uint16_t) + 2 * sizeof(uint64_t);
+    if (rawSize / MAX_ACTION_BYTES > count) {
+      return ValidationError{begin + sizeof(uint64_t),
+                             "compressed sections larger than their actions"};
+    }
+
+    if (rawSize == 0) {
+      if (count != 0 || end - begin != 2 * sizeof(uint64_t)) {
+        return ValidationError{begin, "malformed empty compressed atom"};
+      }
+
+      return std::nullopt;
+    }
+
+    const size_t tableStart = begin + 2 * sizeof(uint64_t);
+    size_t pos = 0;
+    if (!rans::Table::read(m_data.subspan(tableStart, end - tableStart),
+                           pos)) {
+      return ValidationError{tableStart, "invalid rANS frequency table"};
+    }
+
+    const size_t states = rans::streamsFor(rawSize);
+    if (end - tableStart - pos < states * sizeof(uint32_t)) {
+      return ValidationError{tableStart + pos, "truncated rANS stream"};
+    }
+
+    return std::nullopt;
+  }
+
+public:
+  explicit Validator(std::span<const uint8_t> data) : m_data(data) {}
+
+  std::expected<ValidationInfo, ValidationError> run() const {
+    using Container = Replay<>;
+
+    ValidationInfo info;
+
+    constexpr size_t ATOMS_START = Container::HEADER_SIZE + sizeof(uint16_t) +
+                                   Container::META_SIZE;
+    if (m_data.size() < ATOMS_START + 1) {
+      return fail(m_data.size(), "replay too small");
+    }
+
+    if (std::memcmp(m_data.data(), Container::HEADER.data(),
+                    Container::HEADER_SIZE) != 0) {
+      return fail(0, "invalid header");
+    }
+
+    if (load<uint16_t>(Container::HEADER_SIZE) != Container::META_SIZE) {
+      return fail(Container::HEADER_SIZE, "invalid metadata size");
+    }
+
+    const size_t metaStart = Container::HEADER_SIZE + sizeof(uint16_t);
+    const auto meta = load<Metadata>(metaStart);
+    if (meta.m_checksum != 0 && meta.computeChecksum() != meta.m_checksum) {
+      return fail(metaStart, "metadata checksum mismatch");
+    }
+
+    const size_t footer = m_data.size() - 1;
+    if (m_data[footer] != Container::FOOTER) {
+      return fail(footer, "invalid footer");
+    }
+
+    size_t pos = ATOMS_START;
+    while (pos < footer) {
+      const size_t atomStart = pos;
+      if (footer - pos < sizeof(AtomId) + sizeof(uint64_t)) {
+        return fail(atomStart, "truncated atom header");
+      }
+
+      const auto id = load<AtomId>(pos);
+      uint64_t size = load<uint64_t>(pos + sizeof(AtomId));
+      pos += sizeof(AtomId) + sizeof(uint64_t);
+
+      auto flags = AtomFlags::unpack(size >> 56);
+      size &= ~(0xFFull << 56);
+      if (size > footer - pos) {
+        return fail(atomStart, "atom size exceeds remaining replay size");
+      }
+
+      const size_t next = pos + size;
+      size_t end = next;
+
+      if (flags.has(AtomFlags::Checksummed)) {
+        if (size < sizeof(uint32_t)) {
+          return fail(atomStart, "checksummed atom too small");
+        }
+
+        end -= sizeof(uint32_t);
+        if (crc32c::compute(m_data.subspan(pos, end - pos)) !=
+            load<uint32_t>(end)) {
+          return fail(atomStart, "atom checksum mismatch");
+        }
+
+        flags.m_features &= ~AtomFlags::Checksummed;
+      }
+
+      info.m_atoms++;
+
+      if (id != AtomId::Action || !ActionAtom::supports(flags)) {
+        info.m_opaqueAtoms++;
+      } else if (flags.has(AtomFlags::Compressed)) {
+        if (auto error = compressedActions(pos, end)) {
+          return std::unexpected(*error);
+        }
+
+        info.m_opaqueAtoms++;
+      } else {
+        info.m_actions += TRY(actionSections(pos, end, flags));
+        info.m_actionAtoms++;
+      }
+
+      pos = next;
+    }
+
+    return info;
+  }
+};
+
+} // namespace detail
+
+/**
+ * Check that a replay is structurally sound, without decoding it.
+ *
+ * This checks the header, metadata size (and checksum), atom sizes and
+ * checksums, the sections of every action atom (headers, reserved bits,
+ * special section types and sizes) against the action count, and the
+ * footer. Nothing is allocated, and the replay is only scanned once.
+ *
+ * A replay that passes can still hold nonsense (like actions out of order),
+ * but reading its plain action atoms won't fail or over-read.
+ */
+inline std::expected<ValidationInfo, ValidationError>
+validate(std::span<const uint8_t> data) {
+  return detail::Validator(data).run();
+}
+
+} // namespace v3
+
+SLC_NS_END
+
+#endif
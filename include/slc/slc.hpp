@@ -6,6 +6,8 @@
 #include "formats/v2.hpp"
 #include "formats/v3.hpp"
 
+#include "convert.hpp"
+
 SLC_NS_BEGIN
 
 #ifndef SLC_NO_DEFAULT
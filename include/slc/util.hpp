@@ -2,7 +2,9 @@
 #define SLC_UTIL_HPP
 
 #include <bit>
+#include <cstdint>
 #include <iostream>
+#include <optional>
 #include <span>
 
 #define SLC_NS_BEGIN namespace slc {
@@ -46,8 +48,66 @@ template <typename T>
 int largestPowerOfTwo(T n) {
   return n ? 1ULL << exponentOfTwo(n) : 0;
 }
+
+/**
+ * How many bytes are left to read from a stream, if it can tell.
+ * The stream is left where it was.
+ */
+inline std::optional<uint64_t> remainingSize(std::istream &s) {
+  const auto current = s.tellg();
+  if (current == -1) {
+    return std::nullopt;
+  }
+
+  const auto end = s.seekg(0, std::ios::end).tellg();
+  s.seekg(current, std::ios::beg);
+  if (end == -1 || end < current) {
+    return std::nullopt;
+  }
+
+  return static_cast<uint64_t>(end - current);
+}
 } // namespace util
 
+/**
+ * Options for reading replays.
+ */
+struct ReadOptions {
+  /**
+   * The most memory, in bytes, the actions (or inputs) of a replay may take
+   * up once read. Replays that declare more fail to read before anything is
+   * allocated for them, which keeps malformed or malicious files from
+   * forcing huge allocations.
+   */
+  size_t m_memoryBudget = SIZE_MAX;
+};
+
+/**
+ * What's left of the memory budget of a read, see [`ReadOptions`].
+ */
+class MemoryBudget {
+private:
+  size_t m_remaining;
+
+public:
+  explicit MemoryBudget(size_t bytes = SIZE_MAX) : m_remaining(bytes) {}
+
+  /**
+   * Take room for `count` objects of type `T` out of the budget.
+   * Returns false, taking nothing, if they don't fit.
+   */
+  template <typename T> bool take(uint64_t count) {
+    if (count > m_remaining / sizeof(T)) {
+      return false;
+    }
+
+    m_remaining -= count * sizeof(T);
+    return true;
+  }
+
+  size_t remaining() const { return m_remaining; }
+};
+
 SLC_NS_END
 
 #endif // SLC_UTIL_HPP
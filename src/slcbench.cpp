@@ -0,0 +1,512 @@
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#define SLC_NO_DEFAULT
+#include <slc/slc.hpp>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+// Every heap allocation goes through these, so the benchmarks can tell how
+// many allocations an operation makes.
+static std::atomic<size_t> g_allocations = 0;
+static std::atomic<size_t> g_allocatedBytes = 0;
+
+static void *countedAlloc(size_t size, size_t alignment) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  g_allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+
+  void *ptr = alignment > alignof(std::max_align_t)
+                  ? std::aligned_alloc(alignment,
+                                       (size + alignment - 1) & ~(alignment - 1))
+                  : std::malloc(size == 0 ? 1 : size);
+  if (!ptr) {
+    throw std::bad_alloc();
+  }
+
+  return ptr;
+}
+
+void *operator new(size_t size) { return countedAlloc(size, 0); }
+void *operator new[](size_t size) { return countedAlloc(size, 0); }
+void *operator new(size_t size, std::align_val_t al) {
+  return countedAlloc(size, static_cast<size_t>(al));
+}
+void *operator new[](size_t size, std::align_val_t al) {
+  return countedAlloc(size, static_cast<size_t>(al));
+}
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+/**
+ * Peak resident set size, in KiB. Returns 0 if it can't be queried.
+ */
+static size_t peakRss() {
+#ifdef __linux__
+  // VmHWM can be reset (see resetPeakRss), unlike ru_maxrss
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.starts_with("VmHWM:")) {
+      return std::strtoull(line.c_str() + 6, nullptr, 10);
+    }
+  }
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+  }
+#endif
+
+  return 0;
+}
+
+/**
+ * Reset the peak resident set size to the current one, where supported.
+ */
+static void resetPeakRss() {
+#ifdef __linux__
+  std::ofstream clearRefs("/proc/self/clear_refs");
+  clearRefs << "5";
+#endif
+}
+
+struct Event {
+  enum class Kind : uint8_t {
+    Jump = 1,
+    Left = 2,
+    Right = 3,
+    Restart = 4,
+    RestartFull = 5,
+    Death = 6,
+    TPS = 7,
+  };
+
+  uint64_t m_frame;
+  Kind m_kind;
+  bool m_holding = false;
+  bool m_player2 = false;
+  double m_tps = 0.0;
+};
+
+/**
+ * Builds a stream of events the way a bot would record them; every button is
+ * alternately pressed and released.
+ */
+class EventBuilder {
+private:
+  std::vector<Event> m_events;
+  uint64_t m_frame = 0;
+  bool m_holding[2][4] = {};
+
+public:
+  std::mt19937_64 m_rng;
+
+  explicit EventBuilder(uint64_t seed) : m_rng(seed) {}
+
+  uint64_t range(uint64_t low, uint64_t high) {
+    return std::uniform_int_distribution<uint64_t>(low, high)(m_rng);
+  }
+
+  bool chance(double p) {
+    return std::bernoulli_distribution(p)(m_rng);
+  }
+
+  void wait(uint64_t frames) { m_frame += frames; }
+
+  void button(Event::Kind kind, bool p2 = false) {
+    bool &holding = m_holding[p2][static_cast<int>(kind)];
+    holding = !holding;
+
+    m_events.push_back({.m_frame = m_frame,
+                        .m_kind = kind,
+                        .m_holding = holding,
+                        .m_player2 = p2});
+  }
+
+  void death() {
+    m_events.push_back({.m_frame = m_frame, .m_kind = Event::Kind::Death});
+    wait(range(20, 60));
+    m_events.push_back({.m_frame = m_frame, .m_kind = Event::Kind::Restart});
+
+    // Buttons are let go of on restart
+    std::fill(&m_holding[0][0], &m_holding[0][0] + 8, false);
+  }
+
+  void tps(double tps) {
+    m_events.push_back(
+        {.m_frame = m_frame, .m_kind = Event::Kind::TPS, .m_tps = tps});
+  }
+
+  size_t size() const { return m_events.size(); }
+  std::vector<Event> take() { return std::move(m_events); }
+};
+
+struct Scenario {
+  const char *m_name;
+  std::function<void(EventBuilder &)> m_step;
+};
+
+static const Scenario SCENARIOS[] = {
+    // Clicking as fast as possible, mostly a frame or two apart
+    {"clicker",
+     [](EventBuilder &b) {
+       b.wait(b.range(1, 4));
+       b.button(Event::Kind::Jump);
+       if (b.chance(0.0005)) {
+         b.death();
+       }
+     }},
+    // Long holds; wave and ship parts, with the odd same-frame click
+    {"wave",
+     [](EventBuilder &b) {
+       b.wait(b.range(2, 120));
+       b.button(Event::Kind::Jump);
+       if (b.chance(0.1)) {
+         b.button(Event::Kind::Jump);
+       }
+     }},
+    // Platformer levels; movement held for a long time, occasional jumps
+    {"platformer",
+     [](EventBuilder &b) {
+       b.wait(b.chance(0.05) ? b.range(1000, 20000) : b.range(30, 600));
+       b.button(b.chance(0.3) ? Event::Kind::Jump
+                              : static_cast<Event::Kind>(b.range(2, 3)));
+     }},
+    // Dual mode; both players clicking independently
+    {"dual",
+     [](EventBuilder &b) {
+       b.wait(b.range(0, 20));
+       b.button(Event::Kind::Jump, b.chance(0.5));
+     }},
+    // Practice attempts; every attempt plays the same part of a level, up to
+    // a death somewhere along it
+    {"attempts",
+     [](EventBuilder &b) {
+       std::mt19937_64 level(1);
+       const uint64_t length = b.range(10, 1000);
+       for (uint64_t i = 0; i < length; i++) {
+         b.wait(2 + level() % 60);
+         b.button(Event::Kind::Jump);
+       }
+
+       b.death();
+     }},
+    // Practice runs; constant deaths and TPS changes
+    {"chaos",
+     [](EventBuilder &b) {
+       b.wait(b.range(0, 40));
+       if (b.chance(0.02)) {
+         b.tps(120.0 * static_cast<double>(b.range(1, 8)));
+       } else if (b.chance(0.01)) {
+         b.death();
+       } else {
+         b.button(static_cast<Event::Kind>(b.range(1, 3)), b.chance(0.2));
+       }
+     }},
+};
+
+static std::vector<Event> generate(const Scenario &scenario, size_t count,
+                                   uint64_t seed) {
+  EventBuilder builder(seed);
+  while (builder.size() < count) {
+    scenario.m_step(builder);
+  }
+
+  auto events = builder.take();
+  events.resize(count);
+  return events;
+}
+
+static slc::v2::Replay<> buildV2(const std::vector<Event> &events) {
+  using InputType = slc::v2::Input::InputType;
+
+  slc::v2::Replay<> replay;
+  for (const auto &event : events) {
+    if (event.m_kind == Event::Kind::TPS) {
+      (void)replay.addTPSInput(event.m_frame, event.m_tps);
+    } else {
+      (void)replay.addInput(event.m_frame,
+                            static_cast<InputType>(event.m_kind),
+                            event.m_player2, event.m_holding);
+    }
+  }
+
+  return replay;
+}
+
+static slc::v3::Replay<> buildV3(const std::vector<Event> &events,
+                                 bool compressed, bool split,
+                                 slc::v3::EncodingOptions encoding) {
+  using ActionType = slc::v3::Action::ActionType;
+
+  std::vector<slc::v3::Action> actions;
+  actions.reserve(events.size());
+  for (const auto &event : events) {
+    const auto type = static_cast<ActionType>(event.m_kind);
+
+    switch (event.m_kind) {
+    case Event::Kind::TPS:
+      actions.emplace_back(0, event.m_frame, event.m_tps);
+      break;
+    case Event::Kind::Restart:
+    case Event::Kind::RestartFull:
+    case Event::Kind::Death:
+      actions.emplace_back(0, event.m_frame, type, uint64_t{0});
+      break;
+    default:
+      actions.emplace_back(0, event.m_frame, type, event.m_holding,
+                           event.m_player2);
+    }
+  }
+
+  slc::v3::ActionAtom atom;
+  atom.m_compressed = compressed;
+  atom.m_split = split;
+  atom.m_encoding = encoding;
+  (void)atom.addActions(actions);
+
+  slc::v3::Replay<> replay;
+  replay.m_meta = {};
+  replay.m_meta.m_tps = 240.0;
+  replay.m_atoms.add(std::move(atom));
+
+  return replay;
+}
+
+struct Measurement {
+  // Fastest of all runs, in seconds.
+  double m_seconds = 0.0;
+  // Allocations made by one run.
+  size_t m_allocations = 0;
+  size_t m_allocatedBytes = 0;
+  // Peak RSS over all runs, in KiB.
+  size_t m_peakRss = 0;
+};
+
+template <typename F>
+static Measurement measure(size_t repetitions, F &&operation) {
+  Measurement m;
+  m.m_seconds = std::numeric_limits<double>::max();
+
+  resetPeakRss();
+
+  for (size_t i = 0; i < repetitions; i++) {
+    const size_t allocations = g_allocations.load();
+    const size_t allocatedBytes = g_allocatedBytes.load();
+    const auto start = std::chrono::steady_clock::now();
+
+    operation();
+
+    const auto end = std::chrono::steady_clock::now();
+    m.m_seconds = std::min(
+        m.m_seconds, std::chrono::duration<double>(end - start).count());
+    m.m_allocations = g_allocations.load() - allocations;
+    m.m_allocatedBytes = g_allocatedBytes.load() - allocatedBytes;
+  }
+
+  m.m_peakRss = peakRss();
+  return m;
+}
+
+static void report(const char *scenario, const char *format, const char *op,
+                   size_t actions, size_t bytes, const Measurement &m) {
+  std::println("{{\"scenario\":\"{}\",\"format\":\"{}\",\"op\":\"{}\","
+               "\"actions\":{},\"bytes\":{},\"bytes_per_action\":{:.4f},"
+               "\"seconds\":{:.6f},\"actions_per_second\":{:.0f},"
+               "\"mb_per_second\":{:.2f},\"allocations\":{},"
+               "\"allocated_bytes\":{},\"peak_rss_kib\":{}}}",
+               scenario, format, op, actions, bytes,
+               static_cast<double>(bytes) / static_cast<double>(actions),
+               m.m_seconds, static_cast<double>(actions) / m.m_seconds,
+               static_cast<double>(bytes) / m.m_seconds / 1e6, m.m_allocations,
+               m.m_allocatedBytes, m.m_peakRss);
+}
+
+struct BenchOptions {
+  size_t m_actions = 200000;
+  size_t m_repetitions = 5;
+  uint64_t m_seed = 1;
+  std::vector<std::string> m_scenarios;
+};
+
+static void runScenario(const Scenario &scenario,
+                        const BenchOptions &options) {
+  const auto events =
+      generate(scenario, options.m_actions, options.m_seed);
+
+  {
+    auto replay = buildV2(events);
+    std::string encoded;
+
+    auto encode = measure(options.m_repetitions, [&] {
+      std::ostringstream out;
+      replay.write(out);
+      encoded = std::move(out).str();
+    });
+
+    auto decode = measure(options.m_repetitions, [&] {
+      std::istringstream in(encoded);
+      auto result = slc::v2::Replay<>::read(in);
+      if (!result || result->length() != events.size()) {
+        std::println(stderr, "{}: v2 replay failed to decode",
+                     scenario.m_name);
+        std::exit(1);
+      }
+    });
+
+    report(scenario.m_name, "v2", "encode", events.size(), encoded.size(),
+           encode);
+    report(scenario.m_name, "v2", "decode", events.size(), encoded.size(),
+           decode);
+  }
+
+  // Plain, entropy coded, split by player, progression encoded and
+  // back-referenced slc3
+  struct Layout {
+    const char *m_format;
+    bool m_compressed;
+    bool m_split;
+    slc::v3::EncodingOptions m_encoding;
+  };
+
+  constexpr slc::v3::EncodingOptions progressions{.m_progressions = true};
+  constexpr slc::v3::EncodingOptions references{.m_progressions = true,
+                                                .m_backReferences = true};
+
+  for (const auto &[format, compressed, split, encoding] :
+       {Layout{"v3", false, false, {}}, Layout{"v3z", true, false, {}},
+        Layout{"v3s", false, true, {}}, Layout{"v3sz", true, true, {}},
+        Layout{"v3p", false, false, progressions},
+        Layout{"v3pz", true, false, progressions},
+        Layout{"v3r", false, false, references},
+        Layout{"v3rz", true, false, references}}) {
+    auto replay = buildV3(events, compressed, split, encoding);
+    std::string encoded;
+
+    auto encode = measure(options.m_repetitions, [&] {
+      std::ostringstream out;
+      if (!replay.write(out)) {
+        std::println(stderr, "{}: {} replay failed to encode",
+                     scenario.m_name, format);
+        std::exit(1);
+      }
+      encoded = std::move(out).str();
+    });
+
+    auto decode = measure(options.m_repetitions, [&] {
+      std::istringstream in(encoded);
+      auto result = slc::v3::Replay<>::read(in);
+      if (!result) {
+        std::println(stderr, "{}: {} replay failed to decode: {}",
+                     scenario.m_name, format, result.error().m_message);
+        std::exit(1);
+      }
+    });
+
+    report(scenario.m_name, format, "encode", events.size(), encoded.size(),
+           encode);
+    report(scenario.m_name, format, "decode", events.size(), encoded.size(),
+           decode);
+  }
+}
+
+static void printUsage() {
+  std::println("usage: slcbench [-n <actions>] [-r <repetitions>] "
+               "[--seed <seed>] [scenario]...");
+  std::println("");
+  std::print("scenarios:");
+  for (const auto &scenario : SCENARIOS) {
+    std::print(" {}", scenario.m_name);
+  }
+  std::println("");
+  std::println("");
+  std::println("results are printed as one JSON object per line");
+}
+
+static bool parseNumber(std::string_view value, auto &out) {
+  auto [ptr, ec] =
+      std::from_chars(value.data(), value.data() + value.size(), out);
+  return ec == std::errc() && ptr == value.data() + value.size();
+}
+
+int main(int argc, char **argv) {
+  BenchOptions options;
+
+  for (int i = 1; i < argc; i++) {
+    const std::string_view arg = argv[i];
+
+    if ((arg == "-n" || arg == "--actions") && i + 1 < argc) {
+      if (!parseNumber(argv[++i], options.m_actions) ||
+          options.m_actions == 0) {
+        std::println("invalid action count '{}'", argv[i]);
+        return 1;
+      }
+    } else if ((arg == "-r" || arg == "--repetitions") && i + 1 < argc) {
+      if (!parseNumber(argv[++i], options.m_repetitions) ||
+          options.m_repetitions == 0) {
+        std::println("invalid repetition count '{}'", argv[i]);
+        return 1;
+      }
+    } else if (arg == "--seed" && i + 1 < argc) {
+      if (!parseNumber(argv[++i], options.m_seed)) {
+        std::println("invalid seed '{}'", argv[i]);
+        return 1;
+      }
+    } else if (arg.starts_with("-")) {
+      printUsage();
+      return arg == "-h" || arg == "--help" ? 0 : 1;
+    } else {
+      options.m_scenarios.emplace_back(arg);
+    }
+  }
+
+  for (const auto &name : options.m_scenarios) {
+    if (std::ranges::none_of(SCENARIOS, [&](const Scenario &scenario) {
+          return name == scenario.m_name;
+        })) {
+      std::println("unknown scenario '{}'", name);
+      printUsage();
+      return 1;
+    }
+  }
+
+  for (const auto &scenario : SCENARIOS) {
+    if (options.m_scenarios.empty() ||
+        std::ranges::find(options.m_scenarios, scenario.m_name) !=
+            options.m_scenarios.end()) {
+      runScenario(scenario, options);
+    }
+  }
+
+  return 0;
+}
@@ -1,9 +1,18 @@
 #include "slc/formats/v2.hpp"
 #include "slc/formats/v3/atom.hpp"
 #include "slc/formats/v3/builtin.hpp"
+#include <atomic>
+#include <charconv>
 #include <chrono>
+#include <deque>
 #include <filesystem>
+#include <format>
 #include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #define SLC_NO_DEFAULT
 #include <slc/slc.hpp>
 
@@ -19,202 +28,612 @@ template <class... Ts> struct overloads : Ts... {
   using Ts::operator()...;
 };
 
-static void convertSlc2ToSlc3(std::string inputName, std::string outputName) {
+struct ConversionOptions {
+  // Re-read the written replay and compare it against the source.
+  bool m_verify = true;
+  // Print progress for every step; only useful for single conversions.
+  bool m_verbose = true;
+  // Print an encoding breakdown of every slc3 replay that's written.
+  bool m_report = false;
+};
+
+struct ConversionStats {
+  size_t m_inputSize = 0;
+  size_t m_outputSize = 0;
+  size_t m_actions = 0;
+  // Things the target format couldn't represent.
+  size_t m_issues = 0;
+  // How actions were encoded, for slc3 outputs.
+  slc::v3::EncodingReport m_encoding;
+};
+
+using ConversionResult = slc::v3::Result<ConversionStats>;
+
+static void printEncodingReport(const slc::v3::EncodingReport &report) {
+  using Id = slc::v3::Section::Identifier;
+
+  const auto bySize = [&](Id id) {
+    const auto &sizes = report.m_sections[static_cast<size_t>(id)];
+    return std::format("{} (1b: {}, 2b: {}, 4b: {}, 8b: {})",
+                       report.sections(id), sizes[0], sizes[1], sizes[2],
+                       sizes[3]);
+  };
+
+  std::println("input sections: {}", bySize(Id::Input));
+  std::println("repeat sections: {}", bySize(Id::Repeat));
+  std::println("special sections: {}", bySize(Id::Special));
+  std::println("progression sections: {}", bySize(Id::Progression));
+  std::println("{} actions, {} player inputs, {} swift pairs merged",
+               report.m_actions, report.m_playerInputs, report.m_swiftPairs);
+  std::println("repeat coverage: {:.1f}%, average run length: {:.1f} inputs",
+               report.repeatCoverage() * 100.0, report.averageRunLength());
+  std::println("progression coverage: {:.1f}%",
+               report.progressionCoverage() * 100.0);
+  std::println("back-references: {}, copying {:.1f}% of actions",
+               report.m_backReferences, report.referenceCoverage() * 100.0);
+  std::println("bytes: {} headers, {} payload, {} specials ({} total, "
+               "{:.2f} per action)",
+               report.m_headerBytes, report.m_payloadBytes,
+               report.m_specialBytes, report.totalBytes(),
+               report.m_actions == 0
+                   ? 0.0
+                   : static_cast<double>(report.totalBytes()) /
+                         static_cast<double>(report.m_actions));
+}
+
+static ConversionResult convertSlc2ToSlc3(const fs::path &inputName,
+                                          const fs::path &outputName,
+                                          const ConversionOptions &options) {
   const fs::path in_path = fs::current_path() / inputName;
-  size_t oldSize = fs::file_size(in_path);
+  const fs::path out_path = fs::current_path() / outputName;
+  ConversionStats stats;
+  stats.m_inputSize = fs::file_size(in_path);
+
+  std::chrono::high_resolution_clock clock;
+  auto startW = clock.now();
+
+  {
+    if (options.m_verbose) {
+      std::println("converting slc2 replay to slc3...");
+    }
+
+    std::ifstream in(in_path, std::ios::binary);
+    std::ofstream fd(out_path, std::ios::binary);
+    auto result = slc::convert::v2ToV3<OldMeta>(in, fd);
+    if (!result.has_value()) {
+      return std::unexpected(
+          std::format("failed to convert: {}", result.error().m_message));
+    }
+
+    stats.m_actions = result->m_actions;
+    stats.m_encoding = result->m_encoding;
+
+    if (options.m_verbose) {
+      std::println("read {} slc2 inputs, wrote {} slc3 actions",
+                   result->m_inputs, result->m_actions);
+    }
+
+    if (options.m_verbose && options.m_report) {
+      printEncodingReport(stats.m_encoding);
+    }
+  }
+
+  auto endW = clock.now();
+
+  stats.m_outputSize = fs::file_size(out_path);
+
+  if (options.m_verbose) {
+    std::println(
+        "converted in {}",
+        std::chrono::duration_cast<std::chrono::milliseconds>(endW - startW));
+
+    std::println("OLD: {}b, NEW: {}b ({:.2f}% savings)", stats.m_inputSize,
+                 stats.m_outputSize,
+                 (1.0 - (double)stats.m_outputSize / (double)stats.m_inputSize) *
+                     100.0);
+
+    std::println("------------------------------------");
+  }
+
+  if (!options.m_verify) {
+    return stats;
+  }
+
   std::ifstream in(in_path, std::ios::binary);
   auto oldrep = slc::v2::Replay<OldMeta>::read(in);
-  if (oldrep.has_value()) {
-    auto rr = oldrep.value();
+  if (!oldrep.has_value()) {
+    return std::unexpected(std::format(
+        "reading slc2 exited with {}", static_cast<int>(oldrep.error())));
+  }
 
-    std::println("read slc2 replay; {} inputs", rr.length());
+  // verify correctness
+  std::ifstream fd(out_path, std::ios::binary);
+  auto startR = clock.now();
+  auto res = slc::v3::Replay<>::read(fd);
+  if (!res.has_value()) {
+    return std::unexpected(
+        std::format("re-reading failed with {}", res.error().m_message));
+  }
 
-    std::println("------------------------------------");
+  auto &final = res.value();
+  auto endR = clock.now();
+  if (options.m_verbose) {
+    std::println("read slc3 replay with {} atom(s)", final.m_atoms.count());
+    std::println(
+        "read in {}",
+        std::chrono::duration_cast<std::chrono::milliseconds>(endR - startR));
+  }
 
-    slc::v3::Replay<> r;
+  const auto &inputs = oldrep->getInputs();
 
-    r.m_meta.m_tps = oldrep->m_tps;
-    slc::v3::ActionAtom a;
+  const auto visitor = overloads{
+      [&](slc::v3::NullAtom &atom) -> slc::v3::Result<> {
+        if (options.m_verbose) {
+          std::println("null atom with size {}", atom.size);
+        }
+        return {};
+      },
+      [&](slc::v3::ActionAtom &atom) -> slc::v3::Result<> {
+        if (options.m_verbose) {
+          std::println("action atom with {} inputs", atom.m_actions.size());
+          std::println("checking correctness...");
+        }
 
-    using ActionType = slc::v3::Action::ActionType;
+        // Skip inputs are dropped during conversion, so they're not compared
+        size_t j = 0;
+        for (size_t i = 0; i < atom.m_actions.size(); i++, j++) {
+          while (j < inputs.size() &&
+                 inputs[j].m_button == slc::v2::Input::InputType::Skip) {
+            j++;
+          }
+
+          if (j >= inputs.size()) {
+            return std::unexpected(
+                std::format("LENGTH MISMATCH: got more than {} actions", i));
+          }
+
+          const auto &na = atom.m_actions[i];
+          const auto &oa = inputs[j];
+
+          if (na.m_frame != oa.m_frame) {
+            return std::unexpected(
+                std::format("FRAME MISMATCH: got {}, expected {}", na.m_frame,
+                            oa.m_frame));
+          }
+
+          if (static_cast<int>(na.m_type) != static_cast<int>(oa.m_button) ||
+              na.m_holding != oa.m_holding || na.m_player2 != oa.m_player2) {
+            return std::unexpected(std::format(
+                "ACTION MISMATCH at frame {}: {} / {}, {} / {}, swift: {}",
+                na.m_frame, static_cast<int>(na.m_type),
+                static_cast<int>(oa.m_button), na.m_holding, oa.m_holding,
+                na.swift()));
+          }
+        }
 
-    uint64_t currentFrame = 0;
-    for (const auto &input : oldrep->getInputs()) {
-      if (input.m_button == slc::v2::Input::InputType::Skip) {
-        currentFrame = input.m_frame;
-        continue;
-      }
+        while (j < inputs.size() &&
+               inputs[j].m_button == slc::v2::Input::InputType::Skip) {
+          j++;
+        }
 
-      if (static_cast<int>(input.m_button) <
-          static_cast<int>(slc::v2::Input::InputType::Restart)) {
-        a.m_actions.push_back(
-            slc::v3::Action(currentFrame, input.m_frame - currentFrame,
-                            static_cast<ActionType>(input.m_button),
-                            input.m_holding, input.m_player2));
-        currentFrame = input.m_frame;
-        continue;
-      }
+        if (j != inputs.size()) {
+          return std::unexpected(
+              std::format("LENGTH MISMATCH: got {} actions, expected more",
+                          atom.m_actions.size()));
+        }
 
-      if (static_cast<int>(input.m_button) <
-          static_cast<int>(slc::v2::Input::InputType::TPS)) {
-        a.m_actions.push_back(slc::v3::Action(
-            currentFrame, input.m_frame - currentFrame,
-            static_cast<ActionType>(input.m_button), oldrep->m_meta.seed));
-        currentFrame = input.m_frame;
-        continue;
+        if (options.m_verbose) {
+          std::println("replay perfectly converted with 100% parity");
+        }
+        return {};
+      },
+      [&](slc::v3::MarkerAtom &atom) -> slc::v3::Result<> {
+        if (options.m_verbose) {
+          std::println("marker atom with {} marker(s)", atom.length());
+        }
+        return {};
+      }};
+
+  for (auto &atom : final.m_atoms.m_atoms) {
+    if (auto result = std::visit(visitor, atom); !result.has_value()) {
+      return std::unexpected(result.error());
+    }
+  }
+
+  return stats;
+}
+
+static ConversionResult convertSlc3ToSlc2(const fs::path &inputName,
+                                          const fs::path &outputName,
+                                          const ConversionOptions &options) {
+  const fs::path in_path = fs::current_path() / inputName;
+  const fs::path out_path = fs::current_path() / outputName;
+  ConversionStats stats;
+  stats.m_inputSize = fs::file_size(in_path);
+
+  if (options.m_verbose) {
+    std::println("converting slc3 replay to slc2...");
+  }
+
+  std::ifstream in(in_path, std::ios::binary);
+  std::ofstream fd(out_path, std::ios::binary);
+  auto report = slc::convert::v3ToV2<OldMeta>(in, fd);
+  if (!report.has_value()) {
+    return std::unexpected(
+        std::format("failed to convert: {}", report.error().m_message));
+  }
+
+  fd.close();
+
+  stats.m_actions = report->m_actions;
+  stats.m_outputSize = fs::file_size(out_path);
+  stats.m_issues = report->m_issues.size();
+
+  if (options.m_verbose) {
+    std::println("merged {} action atom(s); {} actions into {} slc2 inputs",
+                 report->m_atoms, report->m_actions, report->m_inputs);
+
+    using Kind = slc::convert::DowngradeIssue::Kind;
+    for (const auto &issue : report->m_issues) {
+      switch (issue.m_kind) {
+      case Kind::UnsupportedAtom:
+        std::println("dropped atom #{} with id {}", issue.m_atom,
+                     issue.m_value);
+        break;
+      case Kind::SeedDropped:
+        std::println("dropped seed {} at frame {}", issue.m_value,
+                     issue.m_frame);
+        break;
+      case Kind::MetaSeedDropped:
+        std::println("dropped replay seed {}", issue.m_value);
+        break;
+      case Kind::BugpointAsSkip:
+        std::println("bugpoint at frame {} written as a skip input",
+                     issue.m_frame);
+        break;
       }
+    }
 
-      a.m_actions.push_back(slc::v3::Action(
-          currentFrame, input.m_frame - currentFrame, input.m_tps));
-      currentFrame = input.m_frame;
+    if (report->lossless()) {
+      std::println("replay converted without losing anything");
     }
+  }
+
+  return stats;
+}
 
-    std::println("converted to slc3, adding atom with inputs");
-    r.m_atoms.add(std::move(a));
+/**
+ * A fixed-size thread pool where every worker owns a task queue.
+ *
+ * Workers take tasks from the back of their own queue and steal from the
+ * front of other queues once theirs runs dry, so a few large replays don't
+ * leave the rest of the pool idle. Tasks are expected to be submitted before
+ * [`run`] is called.
+ */
+class WorkStealingPool {
+public:
+  using Task = std::function<void()>;
+
+private:
+  struct Queue {
+    std::mutex m_mutex;
+    std::deque<Task> m_tasks;
+  };
+
+  size_t m_threads;
+  std::unique_ptr<Queue[]> m_queues;
+  size_t m_next = 0;
+
+  bool pop(size_t self, Task &task) {
+    auto &queue = m_queues[self];
+    std::lock_guard lock(queue.m_mutex);
+    if (queue.m_tasks.empty()) {
+      return false;
+    }
 
-    std::chrono::high_resolution_clock clock;
-    auto startW = clock.now();
+    task = std::move(queue.m_tasks.back());
+    queue.m_tasks.pop_back();
+    return true;
+  }
 
-    const fs::path out_path = fs::current_path() / outputName;
-    {
-      std::println("writing slc3 replay...");
-      std::ofstream fd(out_path, std::ios::binary);
-      if (auto result = r.write(fd); !result.has_value()) {
-        std::println("failed to write: {}", result.error().m_message);
-        return;
+  bool steal(size_t self, Task &task) {
+    for (size_t i = 1; i < m_threads; i++) {
+      auto &queue = m_queues[(self + i) % m_threads];
+      std::lock_guard lock(queue.m_mutex);
+      if (queue.m_tasks.empty()) {
+        continue;
       }
+
+      task = std::move(queue.m_tasks.front());
+      queue.m_tasks.pop_front();
+      return true;
     }
 
-    auto endW = clock.now();
+    return false;
+  }
 
-    std::println(
-        "wrote in {}",
-        std::chrono::duration_cast<std::chrono::milliseconds>(endW - startW));
+  void work(size_t self) {
+    Task task;
+    while (pop(self, task) || steal(self, task)) {
+      task();
+    }
+  }
 
-    size_t newSize = fs::file_size(out_path);
+public:
+  explicit WorkStealingPool(size_t threads)
+      : m_threads(std::max<size_t>(threads, 1)),
+        m_queues(std::make_unique<Queue[]>(m_threads)) {}
 
-    std::println("OLD: {}b, NEW: {}b ({:.2f}% savings)", oldSize, newSize,
-                 (1.0 - (double)newSize / (double)oldSize) * 100.0);
+  void submit(Task task) {
+    m_queues[m_next].m_tasks.push_back(std::move(task));
+    m_next = (m_next + 1) % m_threads;
+  }
 
-    std::println("------------------------------------");
+  /**
+   * Run all submitted tasks and wait for them to finish.
+   */
+  void run() {
+    std::vector<std::jthread> workers;
+    workers.reserve(m_threads);
+    for (size_t i = 0; i < m_threads; i++) {
+      workers.emplace_back([this, i] { work(i); });
+    }
+  }
+};
 
-    // verify correctness
-    {
-      std::ifstream fd(out_path, std::ios::binary);
-      auto startR = clock.now();
-      auto res = slc::v3::Replay<>::read(fd);
-      if (res.has_value()) {
-        auto final = res.value();
-        auto endR = clock.now();
-        std::println("read slc3 replay with {} atom(s)", final.m_atoms.count());
-        std::println("read in {}",
-                     std::chrono::duration_cast<std::chrono::milliseconds>(
-                         endR - startR));
-
-        const auto visitor = overloads{
-            [](slc::v3::NullAtom &atom) {
-              std::println("null atom with size {}", atom.size);
-            },
-            [&](slc::v3::ActionAtom &atom) {
-              std::println("action atom with {} inputs", atom.m_actions.size());
-              std::println("checking correctness...");
-
-              for (size_t i = 0; i < atom.m_actions.size(); i++) {
-                const auto &na = atom.m_actions[i];
-                const auto &oa = oldrep->getInputs()[i];
-
-                if (i < 0)
-                  std::println("COMPARING ACTIONS: {} / {}, {} ({}) / {} ({}), "
-                               "{} / {}, SWIFT : {}",
-                               static_cast<int>(na.m_type),
-                               static_cast<int>(oa.m_button), na.m_frame,
-                               na.delta(), oa.m_frame, oa.m_delta, na.m_holding,
-                               oa.m_holding, na.swift());
-
-                if (na.m_frame != oa.m_frame) {
-                  std::println("FRAME MISMATCH: got {}, expected {}",
-                               na.m_frame, oa.m_frame);
-                  return;
-                }
-
-                if (static_cast<int>(na.m_type) !=
-                        static_cast<int>(oa.m_button) ||
-                    na.m_holding != oa.m_holding ||
-                    na.m_player2 != oa.m_player2) {
-                  std::println("ACTION MISMATCH at frame {}", na.m_frame);
-                  std::println("{} / {}, {} / {}, swift: {}",
-                               static_cast<int>(na.m_type),
-                               static_cast<int>(oa.m_button), na.m_holding,
-                               oa.m_holding, na.swift());
-                  return;
-                }
-              }
-
-              std::println("replay perfectly converted with 100% parity");
-            }};
-
-        for (auto &atom : final.m_atoms.m_atoms) {
-          std::visit(visitor, atom);
-        }
-      } else {
-        std::println("re-reading failed with {}", res.error().m_message);
-      }
+struct BatchJob {
+  fs::path m_input;
+  fs::path m_output;
+};
+
+static bool matchesWildcard(std::string_view pattern, std::string_view name) {
+  size_t p = 0, n = 0;
+  size_t star = std::string_view::npos, mark = 0;
+
+  while (n < name.size()) {
+    if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n])) {
+      p++;
+      n++;
+    } else if (p < pattern.size() && pattern[p] == '*') {
+      star = p++;
+      mark = n;
+    } else if (star != std::string_view::npos) {
+      p = star + 1;
+      n = ++mark;
+    } else {
+      return false;
     }
-  } else {
-    std::println("exited with {}", static_cast<int>(oldrep.error()));
   }
+
+  while (p < pattern.size() && pattern[p] == '*') {
+    p++;
+  }
+
+  return p == pattern.size();
 }
 
-static void convertSlc3ToSlc2(std::string inputName, std::string outputName) {
-  const fs::path in_path = fs::current_path() / inputName;
-  // size_t oldSize = fs::file_size(in_path);
-  std::ifstream in(in_path, std::ios::binary);
-  auto oldrep = slc::v3::Replay<>::read(in);
-  if (oldrep.has_value()) {
-    auto rr = oldrep.value();
+/**
+ * Expand an input argument into conversion jobs.
+ *
+ * Directories are walked recursively and mirrored into the output directory;
+ * `*` and `?` wildcards are matched against file names in their parent
+ * directory.
+ */
+static void collectJobs(const std::string &input, const fs::path &outputDir,
+                        std::vector<BatchJob> &jobs) {
+  const fs::path path = input;
+
+  if (fs::is_directory(path)) {
+    for (const auto &entry : fs::recursive_directory_iterator(path)) {
+      if (entry.is_regular_file()) {
+        jobs.push_back({entry.path(),
+                        outputDir / fs::relative(entry.path(), path)});
+      }
+    }
+    return;
+  }
 
-    auto it = std::find_if(
-        rr.m_atoms.m_atoms.begin(), rr.m_atoms.m_atoms.end(), [](auto &v) {
-          return std::visit(
-              [](auto &atom) { return atom.id == slc::v3::AtomId::Action; }, v);
-        });
+  const std::string pattern = path.filename().string();
+  if (pattern.find_first_of("*?") == std::string::npos) {
+    jobs.push_back({path, outputDir / path.filename()});
+    return;
+  }
 
-    slc::v3::ActionAtom atom = std::get<slc::v3::ActionAtom>(*it);
+  const fs::path parent =
+      path.has_parent_path() ? path.parent_path() : fs::path(".");
+  if (!fs::is_directory(parent)) {
+    return;
+  }
 
-    std::println("read slc3 replay; {} inputs", atom.length());
+  for (const auto &entry : fs::directory_iterator(parent)) {
+    if (entry.is_regular_file() &&
+        matchesWildcard(pattern, entry.path().filename().string())) {
+      jobs.push_back({entry.path(), outputDir / entry.path().filename()});
+    }
+  }
+}
 
-    std::println("------------------------------------");
+/**
+ * Check that no job overwrites its own input and that no two jobs write the
+ * same output, since workers would otherwise clobber each other's files.
+ *
+ * Prints every conflict and returns whether there were none.
+ */
+static bool checkJobs(const std::vector<BatchJob> &jobs) {
+  bool ok = true;
+  std::unordered_map<std::string, const BatchJob *> outputs;
+
+  for (const auto &job : jobs) {
+    const fs::path output = fs::weakly_canonical(job.m_output);
+
+    std::error_code ec;
+    if (output == fs::weakly_canonical(job.m_input) ||
+        fs::equivalent(job.m_input, job.m_output, ec)) {
+      std::println("{}: output would overwrite the input",
+                   job.m_input.string());
+      ok = false;
+      continue;
+    }
 
-    slc::v2::Replay<OldMeta> r;
+    auto [it, inserted] = outputs.try_emplace(output.string(), &job);
+    if (!inserted) {
+      std::println("{}: output {} is also written by {}",
+                   job.m_input.string(), job.m_output.string(),
+                   it->second->m_input.string());
+      ok = false;
+    }
+  }
 
-    r.m_tps = oldrep->m_meta.m_tps;
-    for (size_t i = 0; i < atom.m_actions.size(); i++) {
-      const auto &a = atom.m_actions[i];
+  return ok;
+}
 
-      if (a.m_type == slc::v3::Action::ActionType::TPS) {
-        (void)r.addTPSInput(a.m_frame, a.m_tps);
-      } else {
-        (void)r.addInput(a.m_frame,
-                         static_cast<slc::v2::Input::InputType>(a.m_type),
-                         a.m_player2, a.m_holding);
+static void printUsage() {
+  std::println("usage: slcconv <2to3|3to2> <input>... -o <output dir> "
+               "[-j <threads>] [--verify] [--report]");
+  std::println("       slcconv (interactive mode)");
+  std::println("");
+  std::println("inputs may be files, directories or wildcard patterns");
+}
+
+static int runBatch(int argc, char **argv) {
+  const std::string_view mode = argv[1];
+  if (mode != "2to3" && mode != "3to2") {
+    printUsage();
+    return 1;
+  }
+
+  std::vector<std::string> inputs;
+  fs::path outputDir;
+  size_t threads = std::thread::hardware_concurrency();
+  ConversionOptions options{.m_verify = false, .m_verbose = false};
+
+  for (int i = 2; i < argc; i++) {
+    const std::string_view arg = argv[i];
+
+    if ((arg == "-o" || arg == "--output") && i + 1 < argc) {
+      outputDir = argv[++i];
+    } else if ((arg == "-j" || arg == "--threads") && i + 1 < argc) {
+      const std::string_view value = argv[++i];
+      auto [ptr, ec] =
+          std::from_chars(value.data(), value.data() + value.size(), threads);
+      if (ec != std::errc() || ptr != value.data() + value.size()) {
+        std::println("invalid thread count '{}'", value);
+        return 1;
       }
+    } else if (arg == "--verify") {
+      options.m_verify = true;
+    } else if (arg == "--report") {
+      options.m_report = true;
+    } else if (arg.starts_with("-")) {
+      printUsage();
+      return 1;
+    } else {
+      inputs.emplace_back(arg);
     }
+  }
 
-    r.m_meta.seed = rr.m_meta.m_seed;
+  if (inputs.empty() || outputDir.empty()) {
+    printUsage();
+    return 1;
+  }
 
-    const fs::path out_path = fs::current_path() / outputName;
-    {
-      std::println("writing slc2 replay...");
-      std::ofstream fd(out_path, std::ios::binary);
-      r.write(fd);
-    }
+  std::vector<BatchJob> jobs;
+  for (const auto &input : inputs) {
+    collectJobs(input, outputDir, jobs);
+  }
 
-  } else {
-    std::println("exited with {}", oldrep.error().m_message);
+  if (jobs.empty()) {
+    std::println("no input files found");
+    return 1;
   }
+
+  if (!checkJobs(jobs)) {
+    return 1;
+  }
+
+  // Directories are created up front so workers never race on them
+  for (const auto &job : jobs) {
+    fs::create_directories(job.m_output.parent_path());
+  }
+
+  const auto convert =
+      mode == "2to3" ? &convertSlc2ToSlc3 : &convertSlc3ToSlc2;
+
+  std::atomic<size_t> converted = 0;
+  std::atomic<size_t> failed = 0;
+  std::atomic<size_t> inputBytes = 0;
+  std::atomic<size_t> outputBytes = 0;
+  std::atomic<size_t> actions = 0;
+  std::atomic<size_t> issues = 0;
+  std::mutex logMutex;
+  slc::v3::EncodingReport encoding;
+
+  WorkStealingPool pool(threads);
+  for (const auto &job : jobs) {
+    pool.submit([&, job] {
+      ConversionResult result = std::unexpected("unknown error");
+      try {
+        result = convert(job.m_input, job.m_output, options);
+      } catch (const std::exception &e) {
+        result = std::unexpected(e.what());
+      }
+
+      if (!result.has_value()) {
+        failed++;
+        std::lock_guard lock(logMutex);
+        std::println("{}: {}", job.m_input.string(), result.error().m_message);
+        return;
+      }
+
+      converted++;
+      inputBytes += result->m_inputSize;
+      outputBytes += result->m_outputSize;
+      actions += result->m_actions;
+      issues += result->m_issues;
+
+      if (options.m_report) {
+        std::lock_guard lock(logMutex);
+        encoding += result->m_encoding;
+      }
+    });
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  pool.run();
+  auto end = std::chrono::steady_clock::now();
+
+  const double seconds = std::chrono::duration<double>(end - start).count();
+  const double megabytes = static_cast<double>(inputBytes) / (1024.0 * 1024.0);
+
+  std::println("------------------------------------");
+  std::println("converted {} file(s), {} failed, {} thread(s){}",
+               converted.load(), failed.load(), std::max<size_t>(threads, 1),
+               options.m_verify ? ", verified" : "");
+  std::println("{} actions in {:.3f}s ({:.1f} files/s, {:.2f} MB/s)",
+               actions.load(), seconds,
+               static_cast<double>(converted) / seconds, megabytes / seconds);
+  if (issues > 0) {
+    std::println("{} action(s) or atom(s) couldn't be represented exactly",
+                 issues.load());
+  }
+  if (inputBytes > 0) {
+    std::println("OLD: {}b, NEW: {}b ({:.2f}% savings)", inputBytes.load(),
+                 outputBytes.load(),
+                 (1.0 - (double)outputBytes / (double)inputBytes) * 100.0);
+  }
+  if (options.m_report && mode == "2to3") {
+    std::println("------------------------------------");
+    printEncodingReport(encoding);
+  }
+
+  return failed > 0 ? 1 : 0;
 }
 
-int main() {
+int main(int argc, char **argv) {
+  if (argc > 1) {
+    return runBatch(argc, argv);
+  }
+
   std::string inputName;
   std::cout << "input file name: ";
   std::cin >> inputName;
@@ -229,9 +648,17 @@ int main() {
   std::cin >> mode;
   std::cout << "\n\n";
 
+  ConversionResult result;
   if (mode == 1) {
-    convertSlc3ToSlc2(inputName, outputName);
+    result = convertSlc3ToSlc2(inputName, outputName, {});
   } else {
-    convertSlc2ToSlc3(inputName, outputName);
+    result = convertSlc2ToSlc3(inputName, outputName, {.m_report = true});
+  }
+
+  if (!result.has_value()) {
+    std::println("{}", result.error().m_message);
+    return 1;
   }
+
+  return 0;
 }